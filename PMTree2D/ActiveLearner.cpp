@@ -0,0 +1,241 @@
+﻿#include "ActiveLearner.h"
+#include "ForwardSimulator.h"
+#include "SurrogateSimulator.h"
+#include "Evaluation.h"
+#include "LinearRegression.h"
+#include "HierarchicalLR.h"
+#include "KNNRegression.h"
+#include "GaussianProcessRegression.h"
+#include <iostream>
+
+/**
+ * inverseマッピングの学習データを、モデルが最も不確かなところから順に生成する (active learning)。
+ * 各ラウンドでは、ランダムなPMパラメータの候補を大量に作り、その統計情報を代理モデル (SurrogateSimulator) で安価に推定して、
+ * inverseモデルの不確かさでスコア付けし、スコアの高い候補だけ実際に並列に木を生成する。
+ *
+ * 不確かさには、以下のどちらかを使う。
+ *    SCORE_VARIANCE  - ガウス過程のinverseマッピングの予測分散
+ *    SCORE_COMMITTEE - 異なる種類のinverseモデル (LR、hierarchical LR、k近傍法) の推定値のばらつき
+ *
+ * @param statistics	統計情報の種類 (PMTree2D::getStatistics()を参照)
+ * @param scoring		不確かさの種類
+ */
+ActiveLearner::ActiveLearner(int statistics, int scoring) {
+	this->statistics = statistics;
+	this->scoring = scoring;
+	numInitial = 200;
+	poolSize = 5000;
+	batchSize = 100;
+	seed = 0;
+}
+
+/**
+ * 最初にランダムに生成するサンプル数をセットする。
+ */
+void ActiveLearner::setNumInitial(int numInitial) {
+	this->numInitial = numInitial;
+}
+
+/**
+ * 各ラウンドでスコア付けする候補の数をセットする。
+ */
+void ActiveLearner::setPoolSize(int poolSize) {
+	this->poolSize = poolSize;
+}
+
+/**
+ * 各ラウンドで、実際に木を生成するサンプル数をセットする。
+ */
+void ActiveLearner::setBatchSize(int batchSize) {
+	this->batchSize = batchSize;
+}
+
+/**
+ * randomInit()に渡すシードの初期値をセットする。検証データと重ならないようにすること。
+ */
+void ActiveLearner::setSeed(int seed) {
+	this->seed = seed;
+}
+
+/**
+ * 検証データでのエラーがtargetErrorを下回るか、木を生成した回数がmaxSamplesに達するまで、学習データを追加する。
+ * 無効なサンプルも生成した回数に数えるので、候補が無効ばかりでも必ず終了する。
+ * また、1つもサンプルが追加されなかったラウンドがあれば、そこで打ち切る。
+ * 最後に、作成した学習データでinverseモデルを学習し直す。
+ *
+ * @param validation	検証データ
+ * @param targetError	目標のエラー (各列の正規化されたRMSEの平均)
+ * @param maxSamples	最大サンプル数 (木を生成する回数の上限)
+ * @return				作成した学習データ
+ */
+Dataset ActiveLearner::build(const Dataset& validation, double targetError, int maxSamples) {
+	Dataset dataset;
+	generate(randomParams(numInitial), dataset);
+	int attempts = numInitial;
+
+	// エラーの正規化には、検証データの最大値を使う (ラウンド間で比較できるように)
+	cv::Mat_<double> muX, maxX;
+	cv::reduce(validation.X, muX, 0, CV_REDUCE_AVG);
+	cv::reduce(cv::abs(validation.X - cv::repeat(muX, validation.size(), 1)), maxX, 0, CV_REDUCE_MAX);
+	maxX.setTo(1.0, maxX == 0);
+
+	SurrogateSimulator surrogate(statistics);
+	for (int round = 0; ; ++round) {
+		int64 start = cv::getTickCount();
+		fit(dataset);
+		double e = error(predictBatch(validation.Y), validation.X, maxX);
+		std::cout << "Round " << round << ": " << dataset.size() << " samples, error " << e << ", " << Evaluation::seconds(start) << " sec" << std::endl;
+		if (e < targetError || attempts >= maxSamples) break;
+
+		// 候補の統計情報を、代理モデルで推定する
+		cv::Mat_<double> pool = randomParams(poolSize);
+		surrogate.fit(dataset, 200);
+		cv::Mat_<double> S, uncertainty;
+		surrogate.predict(pool, S, uncertainty);
+
+		// スコアの高い候補だけ、実際に木を生成する
+		cv::Mat_<double> scores;
+		score(S, scores);
+		cv::Mat_<int> order;
+		cv::sortIdx(scores, order, CV_SORT_EVERY_COLUMN + CV_SORT_DESCENDING);
+		int n = min(batchSize, maxSamples - attempts);
+		cv::Mat_<double> P(n, pool.cols);
+		for (int i = 0; i < n; ++i) {
+			pool.row(order(i, 0)).copyTo(P.row(i));
+		}
+		int size = dataset.size();
+		generate(P, dataset);
+		attempts += n;
+		if (dataset.size() == size) {
+			std::cout << "Round " << round << ": no valid sample was added" << std::endl;
+			break;
+		}
+	}
+
+	return dataset;
+}
+
+/**
+ * 学習したinverseモデルで、PMパラメータを推定する。
+ * SCORE_COMMITTEEの場合は、各モデルの推定値の平均とする。
+ *
+ * @param Y		high-level indicator (各行が、各クエリを表す)
+ * @return		PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> ActiveLearner::predictBatch(const cv::Mat_<double>& Y) const {
+	cv::Mat_<double> X_hat = models[0]->predictBatch(Y);
+	for (int i = 1; i < models.size(); ++i) {
+		X_hat += models[i]->predictBatch(Y);
+	}
+
+	return X_hat / (double)models.size();
+}
+
+/**
+ * 各列の正規化されたRMSEの平均を計算する。
+ *
+ * @param X_hat		推定したPMパラメータ (各行が、各サンプルを表す)
+ * @param X			真のPMパラメータ (各行が、各サンプルを表す)
+ * @param maxX		PMパラメータの正規化に使った最大値
+ * @return			正規化されたRMSEの平均
+ */
+double ActiveLearner::error(const cv::Mat_<double>& X_hat, const cv::Mat_<double>& X, const cv::Mat_<double>& maxX) {
+	cv::Mat_<double> error, error2;
+	Evaluation::rmse(X_hat, X, maxX, error, error2);
+
+	return cv::mean(error)[0];
+}
+
+/**
+ * inverseモデルを学習する。build()の最後のラウンドでも呼ばれるので、通常は呼ぶ必要はない。
+ * 同じ種類のモデルを、別の学習データで比較する場合に使う。
+ *
+ * @param dataset		学習データ
+ */
+void ActiveLearner::fit(const Dataset& dataset) {
+	models.clear();
+	if (scoring == SCORE_VARIANCE) {
+		models.push_back(new GaussianProcessRegression(4, 30, 500));
+	} else {
+		models.push_back(new LinearRegression());
+		models.push_back(new HierarchicalLR(20));
+		models.push_back(new KNNRegression(5));
+	}
+
+	for (int i = 0; i < models.size(); ++i) {
+		models[i]->fit(dataset);
+	}
+}
+
+/**
+ * 候補の統計情報から、inverseモデルの不確かさのスコアを計算する。
+ * SCORE_COMMITTEEの場合は、正規化したPMパラメータの空間での、各モデルの推定値の分散の和とする。
+ *
+ * @param Y				候補の統計情報 (各行が、各候補を表す)
+ * @param scores [OUT]	スコア (列ベクトル)
+ */
+void ActiveLearner::score(const cv::Mat_<double>& Y, cv::Mat_<double>& scores) const {
+	if (scoring == SCORE_VARIANCE) {
+		const GaussianProcessRegression* gpr = dynamic_cast<const GaussianProcessRegression*>((const InverseModel*)models[0]);
+		gpr->predictBatch(Y, scores);
+		return;
+	}
+
+	int K = models.size();
+	cv::Mat_<double> scale = cv::repeat(models[0]->getMaxX(), Y.rows, 1);
+	vector<cv::Mat_<double> > X_hat(K);
+	cv::Mat_<double> mean = cv::Mat_<double>::zeros(Y.rows, scale.cols);
+	for (int i = 0; i < K; ++i) {
+		X_hat[i] = models[i]->predictBatch(Y) / scale;
+		mean += X_hat[i] / (double)K;
+	}
+
+	cv::Mat_<double> var = cv::Mat_<double>::zeros(Y.rows, scale.cols);
+	for (int i = 0; i < K; ++i) {
+		cv::Mat_<double> diff = X_hat[i] - mean;
+		var += diff.mul(diff);
+	}
+	cv::reduce(var, scores, 1, CV_REDUCE_SUM);
+}
+
+/**
+ * randomInit()で、ランダムなPMパラメータをN個作る。木は生成しないので、すぐに終わる。
+ *
+ * @param N		個数
+ * @return		PMパラメータ (各行が、各候補を表す)
+ */
+cv::Mat_<double> ActiveLearner::randomParams(int N) {
+	PMTree2D tree;
+	tree.headless = true;
+
+	cv::Mat_<double> P;
+	for (int i = 0; i < N; ++i) {
+		tree.randomInit(seed++);
+		vector<float> params = tree.getParams();
+		if (i == 0) P.create(N, params.size());
+		for (int c = 0; c < params.size(); ++c) {
+			P(i, c) = params[c];
+		}
+	}
+
+	return P;
+}
+
+/**
+ * PMパラメータから並列に木を生成し、物理的にOKなものだけ学習データに追加する。
+ *
+ * @param P					PMパラメータ (各行が、各サンプルを表す)
+ * @param dataset [IN/OUT]	学習データ
+ */
+void ActiveLearner::generate(const cv::Mat_<double>& P, Dataset& dataset) const {
+	cv::Mat_<double> S;
+	cv::Mat_<uchar> valid;
+	ForwardSimulator::simulate(P, S, valid, statistics);
+
+	for (int r = 0; r < P.rows; ++r) {
+		if (!valid(r, 0)) continue;
+
+		dataset.X.push_back(P.row(r));
+		dataset.Y.push_back(S.row(r));
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "Dataset.h"
+#include "InverseModel.h"
+
+class ActiveLearner {
+public:
+	enum { SCORE_VARIANCE = 0, SCORE_COMMITTEE };
+
+private:
+	int statistics;
+	int scoring;
+	int numInitial;
+	int poolSize;
+	int batchSize;
+	int seed;
+	vector<cv::Ptr<InverseModel> > models;
+
+public:
+	ActiveLearner(int statistics = 3, int scoring = SCORE_VARIANCE);
+
+	void setNumInitial(int numInitial);
+	void setPoolSize(int poolSize);
+	void setBatchSize(int batchSize);
+	void setSeed(int seed);
+	Dataset build(const Dataset& validation, double targetError, int maxSamples);
+	void fit(const Dataset& dataset);
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y) const;
+
+	static double error(const cv::Mat_<double>& X_hat, const cv::Mat_<double>& X, const cv::Mat_<double>& maxX);
+
+private:
+	void score(const cv::Mat_<double>& Y, cv::Mat_<double>& scores) const;
+	cv::Mat_<double> randomParams(int N);
+	void generate(const cv::Mat_<double>& P, Dataset& dataset) const;
+};
+
@@ -0,0 +1,215 @@
+﻿#include "BaggingRegression.h"
+#include <random>
+#include <algorithm>
+
+/**
+ * 各レプリカを、ブートストラップで選んだ学習データで並列に学習する。
+ * 学習データの行は、レプリカごとに学習の直前にコピーし、学習後に解放する。
+ */
+class ReplicaTrainer : public cv::ParallelLoopBody {
+private:
+	BaggingRegression* bagging;
+	const Dataset& dataset;
+	const cv::Mat_<int>& samples;
+
+public:
+	ReplicaTrainer(BaggingRegression* bagging, const Dataset& dataset, const cv::Mat_<int>& samples) : bagging(bagging), dataset(dataset), samples(samples) {}
+
+	void operator()(const cv::Range& range) const {
+		int M = samples.cols;
+
+		for (int k = range.start; k < range.end; ++k) {
+			Dataset subset(cv::Mat_<double>(M, dataset.X.cols), cv::Mat_<double>(M, dataset.Y.cols));
+			for (int i = 0; i < M; ++i) {
+				dataset.X.row(samples(k, i)).copyTo(subset.X.row(i));
+				dataset.Y.row(samples(k, i)).copyTo(subset.Y.row(i));
+			}
+			bagging->replicas[k]->fit(subset);
+		}
+	}
+};
+
+/**
+ * load()用に、レプリカのない状態で作成する。
+ */
+BaggingRegression::BaggingRegression() {
+	fraction = 1.0;
+	seed = 0;
+}
+
+/**
+ * 任意のinverseモデルのバギング。
+ * 各レプリカは、学習データから復元抽出 (ブートストラップ) したサンプルで学習する。
+ * サンプル数は、学習データの数のfraction倍とする。
+ *
+ * @param replicas		レプリカ (学習前のinverseモデル。同じ種類である必要はない)
+ * @param fraction		各レプリカのサンプル数の、学習データの数に対する割合
+ * @param seed			ブートストラップの乱数のシード
+ */
+BaggingRegression::BaggingRegression(const vector<cv::Ptr<InverseModel> >& replicas, double fraction, unsigned seed) {
+	this->replicas = replicas;
+	this->fraction = fraction;
+	this->seed = seed;
+}
+
+/**
+ * 全てのレプリカを並列に学習する。
+ *
+ * @param dataset		学習データ
+ */
+void BaggingRegression::fit(const Dataset& dataset) {
+	// getMaxX()などで使う、全体の正規化のパラメータ
+	{
+		cv::Mat_<double> X2, Y2;
+		normalize(dataset, X2, Y2);
+	}
+
+	// 各レプリカのサンプルのインデックスを、先に全て選んでおく (並列化しても結果が変わらないように)
+	int N = dataset.size();
+	int M = max(1, (int)(N * fraction));
+	cv::Mat_<int> samples(replicas.size(), M);
+	std::mt19937 mt(seed);
+	std::uniform_int_distribution<int> u(0, N - 1);
+	for (int k = 0; k < samples.rows; ++k) {
+		for (int i = 0; i < M; ++i) {
+			samples(k, i) = u(mt);
+		}
+	}
+
+	cv::parallel_for_(cv::Range(0, replicas.size()), ReplicaTrainer(this, dataset, samples));
+}
+
+/**
+ * 複数のhigh-level indicatorから、PMパラメータをまとめて推定する (各レプリカの推定値の平均)。
+ *
+ * @param Y		high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @return		PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> BaggingRegression::predictBatch(const cv::Mat_<double>& Y) const {
+	cv::Mat_<double> spread;
+	return predictBatch(Y, spread);
+}
+
+/**
+ * 複数のhigh-level indicatorから、PMパラメータとそのばらつきをまとめて推定する。
+ * ばらつきは、各レプリカの推定値の標準偏差とする。
+ *
+ * @param Y				high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @param spread [OUT]	推定値の標準偏差 (各行が、各クエリに対応する)
+ * @return				PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> BaggingRegression::predictBatch(const cv::Mat_<double>& Y, cv::Mat_<double>& spread) const {
+	int K = replicas.size();
+
+	cv::Mat_<double> sum, sum2;
+	for (int k = 0; k < K; ++k) {
+		cv::Mat_<double> X_hat = replicas[k]->predictBatch(Y);
+		if (k == 0) {
+			sum = X_hat.clone();
+			sum2 = X_hat.mul(X_hat);
+		} else {
+			sum += X_hat;
+			sum2 += X_hat.mul(X_hat);
+		}
+	}
+
+	cv::Mat_<double> mean = sum / (double)K;
+	cv::Mat_<double> var = sum2 / (double)K - mean.mul(mean);
+	cv::max(var, 0.0, var);
+	cv::sqrt(var, spread);
+
+	return mean;
+}
+
+/**
+ * レプリカの数を返却する。
+ */
+int BaggingRegression::size() const {
+	return replicas.size();
+}
+
+string BaggingRegression::tag() const {
+	return "BAG ";
+}
+
+/**
+ * 各レプリカを、タグと正規化のパラメータとともに書き出す。
+ */
+void BaggingRegression::write(ofstream& out) const {
+	write(out, false);
+}
+
+/**
+ * 各レプリカを、タグと正規化のパラメータとともに書き出す。
+ * whitenedがtrueの場合 (ファイルの先頭が"INVW") だけ、各レプリカのwhiteningの変換も書き出す
+ * (使わないレプリカは、空の変換)。
+ */
+void BaggingRegression::write(ofstream& out, bool whitened) const {
+	out.write((const char*)&fraction, sizeof(double));
+	out.write((const char*)&seed, sizeof(unsigned));
+
+	int K = replicas.size();
+	out.write((const char*)&K, sizeof(int));
+	for (int k = 0; k < K; ++k) {
+		out.write(replicas[k]->tag().c_str(), 4);
+		writeMat(out, replicas[k]->muX);
+		writeMat(out, replicas[k]->maxX);
+		writeMat(out, replicas[k]->muY);
+		writeMat(out, replicas[k]->maxY);
+		if (whitened) {
+			writeWhitening(out, replicas[k]->whitening);
+		}
+		replicas[k]->write(out, whitened);
+	}
+}
+
+/**
+ * write()で書き出したモデルを読み込む。
+ */
+void BaggingRegression::read(ifstream& in) {
+	read(in, false);
+}
+
+/**
+ * write()で書き出したモデルを読み込む。
+ * whitenedがfalseの場合は、各レプリカのwhiteningの変換がない形式として読み込む。
+ */
+void BaggingRegression::read(ifstream& in, bool whitened) {
+	in.read((char*)&fraction, sizeof(double));
+	in.read((char*)&seed, sizeof(unsigned));
+
+	int K;
+	in.read((char*)&K, sizeof(int));
+	replicas.clear();
+	for (int k = 0; k < K; ++k) {
+		char tag[4];
+		in.read(tag, 4);
+		cv::Ptr<InverseModel> replica = create(string(tag, 4));
+		if (replica.empty()) {
+			in.setstate(ios::failbit);
+			return;
+		}
+
+		replica->muX = readMat(in);
+		replica->maxX = readMat(in);
+		replica->muY = readMat(in);
+		replica->maxY = readMat(in);
+		if (whitened) {
+			replica->whitening = readWhitening(in);
+		}
+		replica->read(in, whitened);
+		replicas.push_back(replica);
+	}
+}
+
+/**
+ * 自身か、いずれかのレプリカがwhiteningを使うかどうかを返却する。
+ */
+bool BaggingRegression::hasWhitening() const {
+	if (InverseModel::hasWhitening()) return true;
+	for (int k = 0; k < replicas.size(); ++k) {
+		if (replicas[k]->hasWhitening()) return true;
+	}
+
+	return false;
+}
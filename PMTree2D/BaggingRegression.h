@@ -0,0 +1,30 @@
+#pragma once
+
+#include "InverseModel.h"
+
+class BaggingRegression : public InverseModel {
+	friend class ReplicaTrainer;
+
+private:
+	vector<cv::Ptr<InverseModel> > replicas;
+	double fraction;
+	unsigned seed;
+
+public:
+	BaggingRegression();
+	BaggingRegression(const vector<cv::Ptr<InverseModel> >& replicas, double fraction = 1.0, unsigned seed = 0);
+
+	void fit(const Dataset& dataset);
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y) const;
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y, cv::Mat_<double>& spread) const;
+	int size() const;
+
+protected:
+	string tag() const;
+	void write(ofstream& out) const;
+	void read(ifstream& in);
+	void write(ofstream& out, bool whitened) const;
+	void read(ifstream& in, bool whitened);
+	bool hasWhitening() const;
+};
+
@@ -0,0 +1,250 @@
+﻿#include "BayesianOptimizer.h"
+#include "ForwardSimulator.h"
+#include <random>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * ベイズ最適化により、指定されたhigh-level indicatorを持つ木のPMパラメータを探索する。
+ * 目的関数 (high-level indicatorの正規化されたRMSEの対数) をPMパラメータ上のガウス過程でモデル化し、
+ * 期待改善量 (expected improvement) が最大となる候補点を、batchSize個ずつ並列に生成して評価する。
+ * 探索は、各パラメータの範囲を[0, 1]に正規化した空間で行う。
+ *
+ * @param scale		high-level indicatorの各列のスケール (エラーの計算時に、差をこれで割る)
+ */
+BayesianOptimizer::BayesianOptimizer(const cv::Mat_<double>& scale) {
+	this->scale = scale.clone();
+	this->scale.setTo(1.0, this->scale == 0);
+
+	vector<float> l, u;
+	PMTree2D::getParamRange(l, u);
+	lower = cv::Mat_<double>(1, l.size());
+	upper = cv::Mat_<double>(1, u.size());
+	for (int i = 0; i < l.size(); ++i) {
+		lower(0, i) = l[i];
+		upper(0, i) = u[i];
+	}
+
+	numInitial = 16;
+	batchSize = 8;
+	maxIterations = 30;
+	numCandidates = 2000;
+	tolerance = 0.01;
+	timeBudget = 60.0;
+	error = 0.0;
+	evaluations = 0;
+}
+
+/**
+ * 最初にランダムに生成するサンプル数をセットする。
+ */
+void BayesianOptimizer::setNumInitial(int numInitial) {
+	this->numInitial = numInitial;
+}
+
+/**
+ * 1回の反復で、並列に生成するサンプル数をセットする。
+ */
+void BayesianOptimizer::setBatchSize(int batchSize) {
+	this->batchSize = batchSize;
+}
+
+void BayesianOptimizer::setMaxIterations(int maxIterations) {
+	this->maxIterations = maxIterations;
+}
+
+/**
+ * 期待改善量を計算する候補点の数をセットする。
+ */
+void BayesianOptimizer::setNumCandidates(int numCandidates) {
+	this->numCandidates = numCandidates;
+}
+
+/**
+ * エラー (high-level indicatorの正規化されたRMSE) がこの値を下回ったら、探索を打ち切る。
+ */
+void BayesianOptimizer::setTolerance(double tolerance) {
+	this->tolerance = tolerance;
+}
+
+/**
+ * 探索にかける時間の上限 [sec] をセットする。
+ */
+void BayesianOptimizer::setTimeBudget(double timeBudget) {
+	this->timeBudget = timeBudget;
+}
+
+/**
+ * 指定されたhigh-level indicatorを持つ木のPMパラメータを探索する。
+ * 各反復では、ガウス過程の予測値を観測値とみなして仮に追加しながら (kriging believer)、
+ * 期待改善量が最大の候補点をbatchSize個選び、まとめて並列に木を生成して評価する。
+ * hyperparameterは、5反復ごとに最適化し直す。
+ *
+ * @param target	high-level indicator (行ベクトル)
+ * @param x0		初期サンプルに含めるPMパラメータ (行ベクトル。空なら、全てランダム)
+ * @return			最も良かったPMパラメータ (行ベクトル)
+ */
+cv::Mat_<double> BayesianOptimizer::solve(const cv::Mat_<double>& target, const cv::Mat_<double>& x0) {
+	int64 startTick = cv::getTickCount();
+
+	int n = lower.cols;
+
+	std::mt19937 mt(0);
+	std::uniform_real_distribution<> U01(0.0, 1.0);
+	std::normal_distribution<> N01(0.0, 1.0);
+
+	// 初期サンプル
+	cv::Mat_<double> Z(numInitial, n);
+	for (int k = 0; k < numInitial; ++k) {
+		for (int i = 0; i < n; ++i) {
+			Z(k, i) = U01(mt);
+		}
+	}
+	if (!x0.empty()) {
+		cv::Mat_<double> z0 = (x0 - lower) / (upper - lower);
+		cv::max(cv::min(z0, 1.0), 0.0, z0);
+		z0.copyTo(Z.row(0));
+	}
+	cv::Mat_<double> costs;
+	evaluate(Z, target, costs);
+	evaluations = Z.rows;
+
+	cv::Mat_<double> params;
+	for (int iter = 0; iter < maxIterations; ++iter) {
+		cv::Point minLoc;
+		cv::minMaxLoc(costs, &error, NULL, &minLoc);
+		if (error < tolerance || (double)(cv::getTickCount() - startTick) / cv::getTickFrequency() > timeBudget) break;
+
+		// 目的関数値 (対数) を標準化する。物理的にNGな木には、これまでの最悪値を与える
+		cv::Mat_<double> y(costs.rows, 1);
+		double worst = log(tolerance);
+		for (int r = 0; r < costs.rows; ++r) {
+			if (costs(r, 0) < 1.0e6) worst = max(worst, log(max(costs(r, 0), 1.0e-6)));
+		}
+		for (int r = 0; r < costs.rows; ++r) {
+			y(r, 0) = costs(r, 0) < 1.0e6 ? log(max(costs(r, 0), 1.0e-6)) : worst;
+		}
+		cv::Scalar mu, sd;
+		cv::meanStdDev(y, mu, sd);
+		y = (y - mu[0]) / max(sd[0], 1.0e-6);
+
+		bool reoptimize = iter % 5 == 0;
+		GaussianProcess gp(Z, y, "", 256, reoptimize ? cv::Mat_<double>() : params);
+		if (reoptimize) {
+			gp.optimize(4, 30, 500);
+			params = gp.getHyperparameters();
+		}
+
+		// 候補点 (半分は一様乱数、半分は最良点の周り)
+		cv::Mat_<double> Zc(numCandidates, n);
+		for (int k = 0; k < numCandidates; ++k) {
+			for (int i = 0; i < n; ++i) {
+				Zc(k, i) = k % 2 == 0 ? U01(mt) : min(max(Z(minLoc.y, i) + 0.1 * N01(mt), 0.0), 1.0);
+			}
+		}
+
+		double fbest;
+		cv::minMaxLoc(y, &fbest);
+		cv::Mat_<double> batch(batchSize, n);
+		for (int b = 0; b < batchSize; ++b) {
+			cv::Mat_<double> ei;
+			expectedImprovement(gp, Zc, fbest, ei);
+			cv::Point maxLoc;
+			cv::minMaxLoc(ei, NULL, NULL, NULL, &maxLoc);
+			Zc.row(maxLoc.y).copyTo(batch.row(b));
+
+			// 選んだ候補点に、予測値を仮の観測値として追加する
+			gp.addSample(Zc.row(maxLoc.y), gp.predictBatch(Zc.row(maxLoc.y)));
+		}
+
+		// 選んだ候補点から、並列に木を生成して評価する
+		cv::Mat_<double> batchCosts;
+		evaluate(batch, target, batchCosts);
+		Z.push_back(batch);
+		costs.push_back(batchCosts);
+		evaluations += batch.rows;
+	}
+
+	cv::Point minLoc;
+	cv::minMaxLoc(costs, &error, NULL, &minLoc);
+
+	return lower + Z.row(minLoc.y).mul(upper - lower);
+}
+
+/**
+ * 最後のsolve()で得られた解のエラーを返却する。
+ */
+double BayesianOptimizer::getError() const {
+	return error;
+}
+
+/**
+ * 最後のsolve()で木を生成した回数を返却する。
+ */
+int BayesianOptimizer::getEvaluations() const {
+	return evaluations;
+}
+
+/**
+ * 候補点群の期待改善量 (最小化) を計算する。
+ * 予測値と予測分散は、GaussianProcess::predictBatch()でまとめて計算する。
+ *
+ * @param gp		目的関数のガウス過程
+ * @param Zc		候補点群 (各行が、各候補点を表す)
+ * @param fbest		これまでの最良の目的関数値
+ * @param ei [OUT]	期待改善量 (列ベクトル)
+ */
+void BayesianOptimizer::expectedImprovement(const GaussianProcess& gp, const cv::Mat_<double>& Zc, double fbest, cv::Mat_<double>& ei) {
+	cv::Mat_<double> variance;
+	cv::Mat_<double> mean = gp.predictBatch(Zc, variance);
+
+	ei.create(Zc.rows, 1);
+	for (int r = 0; r < Zc.rows; ++r) {
+		double s = sqrt(variance(r, 0));
+		double imp = fbest - mean(r, 0);
+		if (s < 1.0e-12) {
+			ei(r, 0) = max(imp, 0.0);
+			continue;
+		}
+
+		// EI = imp Phi(z) + s phi(z)
+		double z = imp / s;
+		double pdf = exp(-0.5 * z * z) / sqrt(2.0 * CV_PI);
+		double t = 1.0 / (1.0 + 0.2316419 * fabs(z));
+		double cdf = 1.0 - pdf * t * (0.319381530 + t * (-0.356563782 + t * (1.781477937 + t * (-1.821255978 + t * 1.330274429))));
+		if (z < 0) cdf = 1.0 - cdf;
+		ei(r, 0) = imp * cdf + s * pdf;
+	}
+}
+
+/**
+ * 各サンプルから木を並列に生成し、high-level indicatorの正規化されたRMSEを計算する。
+ * 物理的にNGな木には、大きなコストを与える。
+ *
+ * @param Z				サンプル群 (正規化した空間。各行が、各サンプルを表す)
+ * @param target		high-level indicator (行ベクトル)
+ * @param costs [OUT]	各サンプルのコスト (列ベクトル)
+ */
+void BayesianOptimizer::evaluate(const cv::Mat_<double>& Z, const cv::Mat_<double>& target, cv::Mat_<double>& costs) const {
+	cv::Mat_<double> P = cv::repeat(lower, Z.rows, 1) + Z.mul(cv::repeat(upper - lower, Z.rows, 1));
+
+	cv::Mat_<double> S;
+	cv::Mat_<uchar> valid;
+	ForwardSimulator::simulate(P, S, valid);
+
+	costs.create(Z.rows, 1);
+	for (int r = 0; r < Z.rows; ++r) {
+		if (!valid(r, 0)) {
+			costs(r, 0) = 1.0e6;
+			continue;
+		}
+
+		double e2 = 0.0;
+		for (int c = 0; c < target.cols; ++c) {
+			double diff = (S(r, c) - target(0, c)) / scale(0, c);
+			e2 += diff * diff;
+		}
+		costs(r, 0) = sqrt(e2 / target.cols);
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "GaussianProcess.h"
+
+class BayesianOptimizer {
+private:
+	cv::Mat_<double> scale;
+	cv::Mat_<double> lower;
+	cv::Mat_<double> upper;
+	int numInitial;
+	int batchSize;
+	int maxIterations;
+	int numCandidates;
+	double tolerance;
+	double timeBudget;
+	double error;
+	int evaluations;
+
+public:
+	BayesianOptimizer(const cv::Mat_<double>& scale);
+
+	void setNumInitial(int numInitial);
+	void setBatchSize(int batchSize);
+	void setMaxIterations(int maxIterations);
+	void setNumCandidates(int numCandidates);
+	void setTolerance(double tolerance);
+	void setTimeBudget(double timeBudget);
+	cv::Mat_<double> solve(const cv::Mat_<double>& target, const cv::Mat_<double>& x0 = cv::Mat_<double>());
+	double getError() const;
+	int getEvaluations() const;
+
+	static void expectedImprovement(const GaussianProcess& gp, const cv::Mat_<double>& Zc, double fbest, cv::Mat_<double>& ei);
+
+private:
+	void evaluate(const cv::Mat_<double>& Z, const cv::Mat_<double>& target, cv::Mat_<double>& costs) const;
+};
+
@@ -0,0 +1,243 @@
+﻿#include "CMAESSolver.h"
+#include "ForwardSimulator.h"
+#include <random>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * CMA-ES (Covariance Matrix Adaptation Evolution Strategy) により、
+ * 指定されたhigh-level indicatorを持つ木のPMパラメータを探索する。
+ * 探索は、各パラメータの範囲を[0, 1]に正規化した空間で行い、
+ * 各世代の個体は、ForwardSimulatorで並列に木を生成して評価する。
+ *
+ * @param scale		high-level indicatorの各列のスケール (エラーの計算時に、差をこれで割る)
+ */
+CMAESSolver::CMAESSolver(const cv::Mat_<double>& scale) {
+	this->scale = scale.clone();
+	this->scale.setTo(1.0, this->scale == 0);
+
+	vector<float> l, u;
+	PMTree2D::getParamRange(l, u);
+	lower = cv::Mat_<double>(1, l.size());
+	upper = cv::Mat_<double>(1, u.size());
+	for (int i = 0; i < l.size(); ++i) {
+		lower(0, i) = l[i];
+		upper(0, i) = u[i];
+	}
+
+	int n = lower.cols;
+	populationSize = 4 + (int)(3 * log((double)n));
+	maxGenerations = 200;
+	tolerance = 0.01;
+	timeBudget = 60.0;
+	error = 0.0;
+	generations = 0;
+	surrogate = NULL;
+}
+
+void CMAESSolver::setPopulationSize(int populationSize) {
+	this->populationSize = populationSize;
+}
+
+void CMAESSolver::setMaxGenerations(int maxGenerations) {
+	this->maxGenerations = maxGenerations;
+}
+
+/**
+ * エラー (high-level indicatorの正規化されたRMSE) がこの値を下回ったら、探索を打ち切る。
+ */
+void CMAESSolver::setTolerance(double tolerance) {
+	this->tolerance = tolerance;
+}
+
+/**
+ * 探索にかける時間の上限 [sec] をセットする。
+ */
+void CMAESSolver::setTimeBudget(double timeBudget) {
+	this->timeBudget = timeBudget;
+}
+
+/**
+ * 個体の評価に使う代理モデルをセットする。NULLの場合は、常に実際に木を生成する。
+ * 代理モデルは、統計情報の種類がgetStatistics3()のものを使うこと。
+ */
+void CMAESSolver::setSurrogate(SurrogateSimulator* surrogate) {
+	this->surrogate = surrogate;
+}
+
+/**
+ * 指定されたhigh-level indicatorを持つ木のPMパラメータを探索する。
+ * x0を指定した場合は、それを初期の平均とする (回帰で推定した値を使うと、世代数を大きく減らせる)。
+ *
+ * @param target	high-level indicator (行ベクトル)
+ * @param x0		初期値 (行ベクトル。空なら、パラメータ範囲の中央)
+ * @param sigma		初期のステップサイズ (正規化した空間での値)
+ * @return			最も良かったPMパラメータ (行ベクトル)
+ */
+cv::Mat_<double> CMAESSolver::solve(const cv::Mat_<double>& target, const cv::Mat_<double>& x0, double sigma) {
+	int64 startTick = cv::getTickCount();
+
+	int n = lower.cols;
+	int lambda = populationSize;
+	int mu = lambda / 2;
+
+	// 重み
+	cv::Mat_<double> weights(mu, 1);
+	for (int i = 0; i < mu; ++i) {
+		weights(i, 0) = log(mu + 0.5) - log(i + 1.0);
+	}
+	weights /= cv::sum(weights)[0];
+	double mueff = 1.0 / cv::sum(weights.mul(weights))[0];
+
+	// パラメータの学習率
+	double cc = (4.0 + mueff / n) / (n + 4.0 + 2.0 * mueff / n);
+	double cs = (mueff + 2.0) / (n + mueff + 5.0);
+	double c1 = 2.0 / ((n + 1.3) * (n + 1.3) + mueff);
+	double cmu = min(1.0 - c1, 2.0 * (mueff - 2.0 + 1.0 / mueff) / ((n + 2.0) * (n + 2.0) + mueff));
+	double damps = 1.0 + 2.0 * max(0.0, sqrt((mueff - 1.0) / (n + 1.0)) - 1.0) + cs;
+	double chiN = sqrt((double)n) * (1.0 - 1.0 / (4.0 * n) + 1.0 / (21.0 * n * n));
+
+	// 初期の平均 (正規化した空間)
+	cv::Mat_<double> mean(1, n, 0.5);
+	if (!x0.empty()) {
+		mean = (x0 - lower) / (upper - lower);
+		cv::max(cv::min(mean, 1.0), 0.0, mean);
+	}
+
+	cv::Mat_<double> C = cv::Mat_<double>::eye(n, n);
+	cv::Mat_<double> pc = cv::Mat_<double>::zeros(1, n);
+	cv::Mat_<double> ps = cv::Mat_<double>::zeros(1, n);
+	cv::Mat_<double> B = cv::Mat_<double>::eye(n, n);
+	cv::Mat_<double> D = cv::Mat_<double>::ones(1, n);
+
+	cv::Mat_<double> best = mean.clone();
+	error = numeric_limits<double>::max();
+
+	std::mt19937 mt(0);
+	std::normal_distribution<> N01(0.0, 1.0);
+
+	for (generations = 0; generations < maxGenerations; ++generations) {
+		// 個体を生成する (x = m + sigma B D z)
+		cv::Mat_<double> Zs(lambda, n);
+		for (int k = 0; k < lambda; ++k) {
+			for (int i = 0; i < n; ++i) {
+				Zs(k, i) = N01(mt) * D(0, i);
+			}
+		}
+		cv::Mat_<double> Ys = Zs * B.t();
+		cv::Mat_<double> Xs = cv::repeat(mean, lambda, 1) + sigma * Ys;
+
+		// 並列に木を生成して評価する
+		cv::Mat_<double> costs;
+		evaluate(Xs, target, costs);
+
+		cv::Mat_<int> order;
+		cv::sortIdx(costs, order, CV_SORT_EVERY_COLUMN + CV_SORT_ASCENDING);
+		if (costs(order(0, 0), 0) < error) {
+			error = costs(order(0, 0), 0);
+			best = Xs.row(order(0, 0)).clone();
+		}
+
+		if (error < tolerance || (double)(cv::getTickCount() - startTick) / cv::getTickFrequency() > timeBudget) {
+			++generations;
+			break;
+		}
+
+		// 平均を更新する
+		cv::Mat_<double> oldMean = mean.clone();
+		mean = cv::Mat_<double>::zeros(1, n);
+		for (int i = 0; i < mu; ++i) {
+			mean += weights(i, 0) * Xs.row(order(i, 0));
+		}
+		cv::Mat_<double> yw = (mean - oldMean) / sigma;
+
+		// 進化パスを更新する (C^-1/2 = B D^-1 B^T)
+		cv::Mat_<double> BinvD = B.clone();
+		for (int i = 0; i < n; ++i) {
+			BinvD.col(i) /= D(0, i);
+		}
+		cv::Mat_<double> invSqrtC = BinvD * B.t();
+		ps = (1.0 - cs) * ps + sqrt(cs * (2.0 - cs) * mueff) * yw * invSqrtC;
+		double psNorm = cv::norm(ps);
+		bool hsig = psNorm / sqrt(1.0 - pow(1.0 - cs, 2.0 * (generations + 1))) / chiN < 1.4 + 2.0 / (n + 1.0);
+		pc = (1.0 - cc) * pc + (hsig ? sqrt(cc * (2.0 - cc) * mueff) : 0.0) * yw;
+
+		// 共分散行列を更新する
+		cv::Mat_<double> rankMu = cv::Mat_<double>::zeros(n, n);
+		for (int i = 0; i < mu; ++i) {
+			cv::Mat_<double> yi = (Xs.row(order(i, 0)) - oldMean) / sigma;
+			rankMu += weights(i, 0) * yi.t() * yi;
+		}
+		C = (1.0 - c1 - cmu) * C + c1 * (pc.t() * pc + (hsig ? 0.0 : cc * (2.0 - cc)) * C) + cmu * rankMu;
+
+		// ステップサイズを更新する
+		sigma *= exp((cs / damps) * (psNorm / chiN - 1.0));
+
+		// C = B D^2 B^T と固有値分解する
+		C = (C + C.t()) * 0.5;
+		cv::Mat_<double> eigenvalues, eigenvectors;
+		cv::eigen(C, eigenvalues, eigenvectors);
+		B = eigenvectors.t();
+		for (int i = 0; i < n; ++i) {
+			D(0, i) = sqrt(max(eigenvalues(i, 0), 1.0e-20));
+		}
+	}
+
+	cv::max(cv::min(best, 1.0), 0.0, best);
+	return lower + best.mul(upper - lower);
+}
+
+/**
+ * 最後のsolve()で得られた解のエラーを返却する。
+ */
+double CMAESSolver::getError() const {
+	return error;
+}
+
+/**
+ * 最後のsolve()でかかった世代数を返却する。
+ */
+int CMAESSolver::getGenerations() const {
+	return generations;
+}
+
+/**
+ * 各個体から木を並列に生成し (代理モデルがあれば、それで推定し)、high-level indicatorの正規化されたRMSEを計算する。
+ * パラメータの範囲外の個体は、範囲内に切り詰めて評価し、はみ出した量をペナルティとして加える。
+ * 物理的にNGな木には、大きなコストを与える。
+ *
+ * @param Z				個体群 (正規化した空間。各行が、各個体を表す)
+ * @param target		high-level indicator (行ベクトル)
+ * @param costs [OUT]	各個体のコスト (列ベクトル)
+ */
+void CMAESSolver::evaluate(const cv::Mat_<double>& Z, const cv::Mat_<double>& target, cv::Mat_<double>& costs) const {
+	cv::Mat_<double> Zc;
+	cv::max(cv::min(Z, 1.0), 0.0, Zc);
+	cv::Mat_<double> P = cv::repeat(lower, Z.rows, 1) + Zc.mul(cv::repeat(upper - lower, Z.rows, 1));
+
+	cv::Mat_<double> S;
+	cv::Mat_<uchar> valid;
+	if (surrogate != NULL) {
+		surrogate->simulate(P, S, valid);
+	} else {
+		ForwardSimulator::simulate(P, S, valid);
+	}
+
+	costs.create(Z.rows, 1);
+	for (int r = 0; r < Z.rows; ++r) {
+		double penalty = cv::norm(Z.row(r), Zc.row(r), cv::NORM_L2SQR);
+		if (!valid(r, 0)) {
+			costs(r, 0) = 1.0e6 + penalty;
+			continue;
+		}
+
+		double e2 = 0.0;
+		for (int c = 0; c < target.cols; ++c) {
+			double diff = (S(r, c) - target(0, c)) / scale(0, c);
+			e2 += diff * diff;
+		}
+		costs(r, 0) = sqrt(e2 / target.cols) + penalty;
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "SurrogateSimulator.h"
+
+class CMAESSolver {
+private:
+	cv::Mat_<double> scale;
+	cv::Mat_<double> lower;
+	cv::Mat_<double> upper;
+	int populationSize;
+	int maxGenerations;
+	double tolerance;
+	double timeBudget;
+	double error;
+	int generations;
+	SurrogateSimulator* surrogate;
+
+public:
+	CMAESSolver(const cv::Mat_<double>& scale);
+
+	void setPopulationSize(int populationSize);
+	void setMaxGenerations(int maxGenerations);
+	void setTolerance(double tolerance);
+	void setTimeBudget(double timeBudget);
+	void setSurrogate(SurrogateSimulator* surrogate);
+	cv::Mat_<double> solve(const cv::Mat_<double>& target, const cv::Mat_<double>& x0 = cv::Mat_<double>(), double sigma = 0.3);
+	double getError() const;
+	int getGenerations() const;
+
+private:
+	void evaluate(const cv::Mat_<double>& Z, const cv::Mat_<double>& target, cv::Mat_<double>& costs) const;
+};
+
@@ -0,0 +1,115 @@
+﻿#include "CrossValidation.h"
+#include "Evaluation.h"
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+/**
+ * (グリッドの値, fold) の組を独立したタスクとして、並列に学習と評価を行う。
+ */
+class FoldEvaluator : public cv::ParallelLoopBody {
+private:
+	const Dataset& dataset;
+	const vector<int>& indices;
+	int numFolds;
+	ModelFactory factory;
+	const vector<double>& values;
+	const cv::Mat_<double>& maxX;
+	cv::Mat_<double>& errors;
+	cv::Mat_<double>& times;
+
+public:
+	FoldEvaluator(const Dataset& dataset, const vector<int>& indices, int numFolds, ModelFactory factory, const vector<double>& values, const cv::Mat_<double>& maxX, cv::Mat_<double>& errors, cv::Mat_<double>& times) : dataset(dataset), indices(indices), numFolds(numFolds), factory(factory), values(values), maxX(maxX), errors(errors), times(times) {}
+
+	void operator()(const cv::Range& range) const {
+		int N = dataset.size();
+
+		for (int task = range.start; task < range.end; ++task) {
+			int v = task / numFolds;
+			int f = task % numFolds;
+
+			// f番目のfoldを検証データ、残りを学習データとする
+			int start = N * f / numFolds;
+			int end = N * (f + 1) / numFolds;
+			Dataset train(cv::Mat_<double>(N - (end - start), dataset.X.cols), cv::Mat_<double>(N - (end - start), dataset.Y.cols));
+			Dataset test(cv::Mat_<double>(end - start, dataset.X.cols), cv::Mat_<double>(end - start, dataset.Y.cols));
+			for (int i = 0, j = 0; i < N; ++i) {
+				if (i >= start && i < end) {
+					dataset.X.row(indices[i]).copyTo(test.X.row(i - start));
+					dataset.Y.row(indices[i]).copyTo(test.Y.row(i - start));
+				} else {
+					dataset.X.row(indices[i]).copyTo(train.X.row(j));
+					dataset.Y.row(indices[i]).copyTo(train.Y.row(j));
+					++j;
+				}
+			}
+
+			cv::Ptr<InverseModel> model = factory(values[v]);
+			int64 startTick = cv::getTickCount();
+			model->fit(train);
+			times(v, f) = Evaluation::seconds(startTick);
+
+			cv::Mat_<double> error, error2;
+			Evaluation::rmse(model->predictBatch(test.Y), test.X, maxX, error, error2);
+			errors(v, f) = cv::mean(error)[0];
+		}
+	}
+};
+
+/**
+ * k-fold交差検証で、グリッドの各値のinverseモデルを評価する。
+ * 学習データを1回だけシャッフルしてnumFolds個に分け、(値, fold) の全ての組を並列に学習、評価する。
+ * エラーは、各列の正規化されたRMSEの平均とする。正規化には、全データの最大値を使う。
+ *
+ * @param dataset		学習データ
+ * @param numFolds		foldの数
+ * @param factory		グリッドの値からモデルを作成する関数
+ * @param values		グリッドの値
+ * @param errors [OUT]	検証データでのエラー (各行が各値、各列が各foldに対応する)
+ * @param times [OUT]	学習時間 [sec] (各行が各値、各列が各foldに対応する)
+ * @param seed			シャッフルの乱数のシード
+ */
+void CrossValidation::run(const Dataset& dataset, int numFolds, ModelFactory factory, const vector<double>& values, cv::Mat_<double>& errors, cv::Mat_<double>& times, unsigned seed) {
+	int N = dataset.size();
+
+	vector<int> indices(N);
+	for (int i = 0; i < N; ++i) indices[i] = i;
+	std::mt19937 mt(seed);
+	for (int i = N - 1; i > 0; --i) {
+		std::uniform_int_distribution<int> u(0, i);
+		swap(indices[i], indices[u(mt)]);
+	}
+
+	cv::Mat_<double> muX, maxX;
+	cv::reduce(dataset.X, muX, 0, CV_REDUCE_AVG);
+	cv::reduce(cv::abs(dataset.X - cv::repeat(muX, N, 1)), maxX, 0, CV_REDUCE_MAX);
+	maxX.setTo(1.0, maxX == 0);
+
+	errors.create(values.size(), numFolds);
+	times.create(values.size(), numFolds);
+	cv::parallel_for_(cv::Range(0, values.size() * numFolds), FoldEvaluator(dataset, indices, numFolds, factory, values, maxX, errors, times));
+}
+
+/**
+ * 交差検証の結果を、表として表示する。
+ * 各行は、グリッドの値、エラーの平均と標準偏差 (fold間)、学習時間の平均。
+ *
+ * @param name		グリッドの値の名前
+ * @param values	グリッドの値
+ * @param errors	検証データでのエラー (run()の出力)
+ * @param times		学習時間 (run()の出力)
+ */
+void CrossValidation::print(const string& name, const vector<double>& values, const cv::Mat_<double>& errors, const cv::Mat_<double>& times) {
+	int best = 0;
+	std::cout << std::setw(12) << name << std::setw(12) << "error" << std::setw(12) << "std" << std::setw(12) << "time" << std::endl;
+	for (int v = 0; v < values.size(); ++v) {
+		cv::Scalar mean, stddev;
+		cv::meanStdDev(errors.row(v), mean, stddev);
+		double time = cv::mean(times.row(v))[0];
+		std::cout << std::setw(12) << values[v] << std::setw(12) << mean[0] << std::setw(12) << stddev[0] << std::setw(12) << time << std::endl;
+
+		if (mean[0] < cv::mean(errors.row(best))[0]) best = v;
+	}
+	std::cout << "Best " << name << ": " << values[best] << std::endl;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "Dataset.h"
+#include "InverseModel.h"
+
+/**
+ * Creates an untrained inverse model from a value of the grid.
+ */
+typedef cv::Ptr<InverseModel> (*ModelFactory)(double value);
+
+class CrossValidation {
+protected:
+	CrossValidation() {}
+
+public:
+	static void run(const Dataset& dataset, int numFolds, ModelFactory factory, const vector<double>& values, cv::Mat_<double>& errors, cv::Mat_<double>& times, unsigned seed = 0);
+	static void print(const string& name, const vector<double>& values, const cv::Mat_<double>& errors, const cv::Mat_<double>& times);
+};
+
@@ -1,99 +1,338 @@
 ﻿#include "DataPartition.h"
+#include <random>
 
 using namespace std;
 
+/**
+ * 2つのベクトルの距離の2乗を計算する。
+ */
+static inline double distance2(const float* a, const float* b, int n) {
+	double d = 0.0;
+	for (int i = 0; i < n; ++i) {
+		d += (a[i] - b[i]) * (a[i] - b[i]);
+	}
+	return d;
+}
+
+/**
+ * k-meansの複数の試行を、並列に実行する。
+ */
+class KMeansAttempt : public cv::ParallelLoopBody {
+private:
+	const cv::Mat_<float>& Y;
+	int maxIterations;
+	vector<cv::Mat_<int> >& labels;
+	vector<cv::Mat_<float> >& centroids;
+	vector<double>& compactness;
+
+public:
+	KMeansAttempt(const cv::Mat_<float>& Y, int maxIterations, vector<cv::Mat_<int> >& labels, vector<cv::Mat_<float> >& centroids, vector<double>& compactness) : Y(Y), maxIterations(maxIterations), labels(labels), centroids(centroids), compactness(compactness) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int a = range.start; a < range.end; ++a) {
+			compactness[a] = DataPartition::twoMeans(Y, a, maxIterations, labels[a], centroids[a]);
+		}
+	}
+};
+
+/**
+ * 分割した2つの子を、並列に再帰的に分割する。
+ * 子はそれぞれ別の行範囲しか触らないので、互いに干渉しない。
+ */
+class ChildPartitioner : public cv::ParallelLoopBody {
+private:
+	cv::Mat_<float>& samples;
+	vector<int>& indices;
+	const cv::Range* children;
+	int minSize;
+	vector<vector<cv::Range> >& childClusters;
+	vector<vector<PartitionNode> >& childNodes;
+
+public:
+	ChildPartitioner(cv::Mat_<float>& samples, vector<int>& indices, const cv::Range* children, int minSize, vector<vector<cv::Range> >& childClusters, vector<vector<PartitionNode> >& childNodes) : samples(samples), indices(indices), children(children), minSize(minSize), childClusters(childClusters), childNodes(childNodes) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int i = range.start; i < range.end; ++i) {
+			DataPartition::partition(samples, indices, children[i].start, children[i].end, minSize, childClusters[i], childNodes[i]);
+		}
+	}
+};
+
 /**
  * データYをk-meansクラスタリングで階層的に分割していく。
- * それに合わせて、データX、データZも分割する。
- * データX、データY、データZの行数は同じであること。
+ * データはコピーせず、quicksortのように並べ替えたindex配列と、
+ * 各クラスタがその中で占める範囲だけを返却する。
+ * 他のデータ (X、Zなど) は、permute()で一度だけ並べ替えれば、
+ * 各クラスタのデータはその行範囲 (rowRange) として参照できる。
+ *
+ * @param Y						データY
+ * @param minSize				クラスタの最小サイズ
+ * @param indices [OUT]			並べ替え後の各行の、元データでのindex番号
+ * @param clusters [OUT]		各クラスタの、並べ替え後のデータでの行範囲
+ */
+void DataPartition::partition(const cv::Mat& Y, int minSize, vector<int>& indices, vector<cv::Range>& clusters) {
+	vector<PartitionNode> nodes;
+	partition(Y, minSize, indices, clusters, nodes);
+}
+
+/**
+ * partition()と同様にデータYを階層的に分割し、分割の木も返却する。
+ * 木の各節点は2つの子の中心を持つので、route()で新しいデータの属するクラスタを求められる。
+ * nodes[0]が根である。
  *
- * @param X						データX
  * @param Y						データY
- * @param Z						データZ
- * @param indices				各データ要素の、元データでのindex番号
  * @param minSize				クラスタの最小サイズ
- * @param clusterX [OUT]		データXのクラスタリング結果
- * @param clusterY [OUT]		データYのクラスタリング結果
- * @param clusterZ [OUT]		データZのクラスタリング結果
- * @param clusterIndices [OUT]	クラスタリング結果における各要素の、元データでのindex番号
+ * @param indices [OUT]			並べ替え後の各行の、元データでのindex番号
+ * @param clusters [OUT]		各クラスタの、並べ替え後のデータでの行範囲
+ * @param nodes [OUT]			分割の木
  */
-void DataPartition::partition(cv::Mat_<float> X, cv::Mat_<float> Y, cv::Mat_<float> Z, vector<int> indices, int minSize, vector<cv::Mat_<float> >&clusterX, vector<cv::Mat_<float> >&clusterY, vector<cv::Mat_<float> >&clusterZ, vector<vector<int> >& clusterIndices) {
-	// サンプル数が32未満になるまで、繰り返し、dataX2、dataY2を分割する。
-	cv::Mat samples;
+void DataPartition::partition(const cv::Mat& Y, int minSize, vector<int>& indices, vector<cv::Range>& clusters, vector<PartitionNode>& nodes) {
+	cv::Mat_<float> samples;
 	Y.convertTo(samples, CV_32F);
-	cv::Mat centroids;
-	cv::Mat labels;
-	//cv::TermCriteria cri(cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS, 50, FLT_EPSILON);
-	cv::TermCriteria cri(cv::TermCriteria::COUNT, 200, FLT_EPSILON);
-	double compactness = cv::kmeans(samples, 2, labels, cri, 200, cv::KMEANS_PP_CENTERS, centroids);
-		
+
+	indices.resize(Y.rows);
+	for (int i = 0; i < Y.rows; ++i) indices[i] = i;
+	clusters.clear();
+	nodes.clear();
+
+	partition(samples, indices, 0, Y.rows, minSize, clusters, nodes);
+}
+
+/**
+ * 分割の木を根から辿り、データyが属するクラスタ番号を返却する。
+ * 各節点では、中心が近い方の子に進むので、O(depth * cols)で済む。
+ *
+ * @param nodes			分割の木
+ * @param y				データ (partition()に渡したデータYと同じ列)
+ * @param cols			データの次元数
+ * @return				クラスタ番号
+ */
+int DataPartition::route(const vector<PartitionNode>& nodes, const float* y, int cols) {
+	int n = 0;
+	while (!nodes[n].isLeaf()) {
+		double d0 = distance2(y, nodes[n].centroids[0], cols);
+		double d1 = distance2(y, nodes[n].centroids[1], cols);
+		n = nodes[n].children[d0 <= d1 ? 0 : 1];
+	}
+
+	return nodes[n].cluster;
+}
+
+/**
+ * 並べ替え後のindex配列に従って、データの行を並べ替えたコピーを返却する。
+ *
+ * @param X				データ
+ * @param indices		並べ替え後の各行の、元データでのindex番号
+ * @return				並べ替えたデータ
+ */
+cv::Mat DataPartition::permute(const cv::Mat& X, const vector<int>& indices) {
+	cv::Mat ret(indices.size(), X.cols, X.type());
+	for (int r = 0; r < indices.size(); ++r) {
+		X.row(indices[r]).copyTo(ret.row(r));
+	}
+
+	return ret;
+}
+
+/**
+ * samplesの[start, end)の行を2つのクラスタに分け、ラベル0の行を前に、ラベル1の行を後ろに
+ * samplesとindicesの中で入れ替えて、それぞれを並列に再帰的に分割する。
+ *
+ * @param samples [IN/OUT]		並べ替え中のデータY
+ * @param indices [IN/OUT]		並べ替え中の各行の、元データでのindex番号
+ * @param start					分割する範囲の先頭
+ * @param end					分割する範囲の末尾 (この行は含まない)
+ * @param minSize				クラスタの最小サイズ
+ * @param clusters [OUT]		各クラスタの行範囲
+ */
+void DataPartition::partition(cv::Mat_<float>& samples, vector<int>& indices, int start, int end, int minSize, vector<cv::Range>& clusters, vector<PartitionNode>& nodes) {
+	// この部分木の根
+	nodes.push_back(PartitionNode());
+
+	// どう分けても最小サイズを下回るなら、k-meansを実行するまでもない
+	if (end - start < minSize * 2) {
+		nodes.back().cluster = clusters.size();
+		clusters.push_back(cv::Range(start, end));
+		return;
+	}
+
+	cv::Mat_<float> Y = samples.rowRange(start, end);
+	cv::Mat_<float> centroids;
+	cv::Mat_<int> labels;
+	kmeans(Y, 8, 100, labels, centroids);
+
 	int nClass1 = cv::countNonZero(labels);
-	int nClass0 = X.rows - nClass1;
+	int nClass0 = Y.rows - nClass1;
 
 	if (nClass1 < minSize || nClass0 < minSize) {
-		clusterX.push_back(X);
-		clusterY.push_back(Y);
-		clusterZ.push_back(Z);
-		clusterIndices.push_back(indices);
+		nodes.back().cluster = clusters.size();
+		clusters.push_back(cv::Range(start, end));
 		return;
 	}
 
-	cv::Mat_<float> classX0(nClass0, X.cols);
-	cv::Mat_<float> classX1(nClass1, X.cols);
-	cv::Mat_<float> classY0(nClass0, Y.cols);
-	cv::Mat_<float> classY1(nClass1, Y.cols);
-	cv::Mat_<float> classZ0(nClass0, Z.cols);
-	cv::Mat_<float> classZ1(nClass1, Z.cols);
-	vector<int> indices0(nClass0);
-	vector<int> indices1(nClass1);
-
-	int index0 = 0;
-	int index1 = 0;
-	for (int r = 0; r < X.rows; ++r) {
-		if (labels.at<float>(r, 0) == 0) {
-			for (int c = 0; c < X.cols; ++c) {
-				classX0(index0, c) = X(r, c);
-			}
-			for (int c = 0; c < Y.cols; ++c) {
-				classY0(index0, c) = Y(r, c);
-			}
-			for (int c = 0; c < Z.cols; ++c) {
-				classZ0(index0, c) = Z(r, c);
+	// quicksortのpartitionと同様に、両端から入れ替えていく
+	int i = 0;
+	int j = Y.rows - 1;
+	while (true) {
+		while (i < j && labels(i, 0) == 0) ++i;
+		while (i < j && labels(j, 0) != 0) --j;
+		if (i >= j) break;
+
+		float* yi = Y[i];
+		float* yj = Y[j];
+		for (int c = 0; c < Y.cols; ++c) {
+			swap(yi[c], yj[c]);
+		}
+		swap(indices[start + i], indices[start + j]);
+		swap(labels(i, 0), labels(j, 0));
+	}
+
+	cv::Range children[2] = { cv::Range(start, start + nClass0), cv::Range(start + nClass0, end) };
+	vector<vector<cv::Range> > childClusters(2);
+	vector<vector<PartitionNode> > childNodes(2);
+	cv::parallel_for_(cv::Range(0, 2), ChildPartitioner(samples, indices, children, minSize, childClusters, childNodes));
+
+	// 子の部分木を、節点番号とクラスタ番号をずらしながらマージする
+	nodes[0].centroids = centroids;
+	for (int i = 0; i < 2; ++i) {
+		int nodeOffset = nodes.size();
+		int clusterOffset = clusters.size();
+		nodes[0].children[i] = nodeOffset;
+		for (int n = 0; n < childNodes[i].size(); ++n) {
+			PartitionNode node = childNodes[i][n];
+			if (node.isLeaf()) {
+				node.cluster += clusterOffset;
+			} else {
+				node.children[0] += nodeOffset;
+				node.children[1] += nodeOffset;
 			}
-			indices0[index0] = indices[r];
+			nodes.push_back(node);
+		}
+		clusters.insert(clusters.end(), childClusters[i].begin(), childClusters[i].end());
+	}
+}
+
+/**
+ * データYを2-meansで2つに分ける。
+ * 異なる初期値で複数回並列に試行し、compactnessが最小の結果を返却する。
+ *
+ * @param Y						データY
+ * @param attempts				試行回数
+ * @param maxIterations			各試行の最大反復回数
+ * @param labels [OUT]			各行のラベル (0 or 1)
+ * @param centroids [OUT]		各クラスタの中心 (2 x Y.cols)
+ * @return						compactness (各行と中心の距離の2乗和)
+ */
+double DataPartition::kmeans(const cv::Mat_<float>& Y, int attempts, int maxIterations, cv::Mat_<int>& labels, cv::Mat_<float>& centroids) {
+	vector<cv::Mat_<int> > attemptLabels(attempts);
+	vector<cv::Mat_<float> > attemptCentroids(attempts);
+	vector<double> compactness(attempts);
+	cv::parallel_for_(cv::Range(0, attempts), KMeansAttempt(Y, maxIterations, attemptLabels, attemptCentroids, compactness));
+
+	int best = min_element(compactness.begin(), compactness.end()) - compactness.begin();
+	labels = attemptLabels[best];
+	centroids = attemptCentroids[best];
 
-			index0++;
-		} else {
-			for (int c = 0; c < X.cols; ++c) {
-				classX1(index1, c) = X(r, c);
+	return compactness[best];
+}
+
+/**
+ * k-means++で初期化した2-meansを1回実行する。
+ * ラベルが変化しなくなったら、反復を打ち切る。
+ * データ数が多い場合は、ランダムに選んだミニバッチで中心を更新し、最後に全データを割り当てる。
+ *
+ * @param Y						データY
+ * @param seed					乱数のシード
+ * @param maxIterations			最大反復回数
+ * @param labels [OUT]			各行のラベル (0 or 1)
+ * @param centroids [OUT]		各クラスタの中心 (2 x Y.cols)
+ * @return						compactness (各行と中心の距離の2乗和)
+ */
+double DataPartition::twoMeans(const cv::Mat_<float>& Y, unsigned seed, int maxIterations, cv::Mat_<int>& labels, cv::Mat_<float>& centroids) {
+	const int batchSize = 1024;
+
+	int N = Y.rows;
+	std::mt19937 mt(seed);
+
+	// k-means++: 1つ目の中心はランダムに、2つ目は距離の2乗に比例する確率で選ぶ
+	centroids.create(2, Y.cols);
+	Y.row(std::uniform_int_distribution<>(0, N - 1)(mt)).copyTo(centroids.row(0));
+	vector<double> dist(N);
+	double total = 0.0;
+	for (int r = 0; r < N; ++r) {
+		dist[r] = distance2(Y[r], centroids[0], Y.cols);
+		total += dist[r];
+	}
+	if (total > 0.0) {
+		std::discrete_distribution<> d(dist.begin(), dist.end());
+		Y.row(d(mt)).copyTo(centroids.row(1));
+	} else {
+		// 全データが同じ点なので、分けられない
+		centroids.row(0).copyTo(centroids.row(1));
+	}
+
+	labels.create(N, 1);
+	if (N <= batchSize) {
+		labels = -1;
+		for (int iter = 0; iter < maxIterations; ++iter) {
+			cv::Mat_<int> prevLabels = labels.clone();
+			assign(Y, centroids, labels);
+			if (cv::countNonZero(labels != prevLabels) == 0) break;
+
+			// 中心を更新する
+			cv::Mat_<double> sums = cv::Mat_<double>::zeros(2, Y.cols);
+			int counts[2] = { 0, 0 };
+			for (int r = 0; r < N; ++r) {
+				for (int c = 0; c < Y.cols; ++c) {
+					sums(labels(r, 0), c) += Y(r, c);
+				}
+				counts[labels(r, 0)]++;
 			}
-			for (int c = 0; c < Y.cols; ++c) {
-				classY1(index1, c) = Y(r, c);
+			for (int k = 0; k < 2; ++k) {
+				if (counts[k] == 0) continue;
+				for (int c = 0; c < Y.cols; ++c) {
+					centroids(k, c) = sums(k, c) / counts[k];
+				}
 			}
-			for (int c = 0; c < Z.cols; ++c) {
-				classZ1(index1, c) = Z(r, c);
+		}
+	} else {
+		// ミニバッチk-means (各中心の学習率は、割り当てられた回数の逆数)
+		std::uniform_int_distribution<> u(0, N - 1);
+		int counts[2] = { 0, 0 };
+		for (int iter = 0; iter < maxIterations; ++iter) {
+			cv::Mat_<float> prevCentroids = centroids.clone();
+			for (int b = 0; b < batchSize; ++b) {
+				int r = u(mt);
+				int k = distance2(Y[r], centroids[0], Y.cols) <= distance2(Y[r], centroids[1], Y.cols) ? 0 : 1;
+				counts[k]++;
+				float eta = 1.0f / counts[k];
+				for (int c = 0; c < Y.cols; ++c) {
+					centroids(k, c) += eta * (Y(r, c) - centroids(k, c));
+				}
 			}
-			indices1[index1] = indices[r];
-
-			index1++;
+			if (cv::norm(centroids, prevCentroids, cv::NORM_L2SQR) < FLT_EPSILON) break;
 		}
 	}
 
-	/*
-	vector<cv::Mat_<float> > clusterX0, clusterX1;
-	vector<cv::Mat_<float> > clusterY0, clusterY1;
-	vector<cv::Mat_<float> > clusterZ0, clusterZ1;
-	*/
-	partition(classX0, classY0, classZ0, indices0, minSize, clusterX, clusterY, clusterZ, clusterIndices);
-	partition(classX1, classY1, classZ1, indices1, minSize, clusterX, clusterY, clusterZ, clusterIndices);
-
-	// clusterをマージする
-	/*
-	clusterX.insert(clusterX.end(), clusterX0.begin(), clusterX0.end());
-	clusterX.insert(clusterX.end(), clusterX1.begin(), clusterX1.end());
-	clusterY.insert(clusterY.end(), clusterY0.begin(), clusterY0.end());
-	clusterY.insert(clusterY.end(), clusterY1.begin(), clusterY1.end());
-	clusterZ.insert(clusterZ.end(), clusterZ0.begin(), clusterZ0.end());
-	clusterZ.insert(clusterZ.end(), clusterZ1.begin(), clusterZ1.end());
-	*/
+	return assign(Y, centroids, labels);
+}
+
+/**
+ * 各行を、最も近い中心のクラスタに割り当てる。
+ *
+ * @param Y						データY
+ * @param centroids				各クラスタの中心
+ * @param labels [OUT]			各行のラベル
+ * @return						compactness (各行と中心の距離の2乗和)
+ */
+double DataPartition::assign(const cv::Mat_<float>& Y, const cv::Mat_<float>& centroids, cv::Mat_<int>& labels) {
+	double compactness = 0.0;
+	for (int r = 0; r < Y.rows; ++r) {
+		double d0 = distance2(Y[r], centroids[0], Y.cols);
+		double d1 = distance2(Y[r], centroids[1], Y.cols);
+		labels(r, 0) = d0 <= d1 ? 0 : 1;
+		compactness += min(d0, d1);
+	}
+
+	return compactness;
 }
@@ -5,11 +5,33 @@
 
 using namespace std;
 
+class PartitionNode {
+public:
+	cv::Mat_<float> centroids;
+	int children[2];
+	int cluster;
+
+public:
+	PartitionNode() : cluster(-1) { children[0] = children[1] = -1; }
+	bool isLeaf() const { return cluster >= 0; }
+};
+
 class DataPartition {
+	friend class ChildPartitioner;
+
 protected:
 	DataPartition() {}
 
 public:
-	static void partition(cv::Mat_<float> X, cv::Mat_<float> Y, cv::Mat_<float> Z, vector<int> indices, int minSize, vector<cv::Mat_<float> >&clusterX, vector<cv::Mat_<float> >&clusterY, vector<cv::Mat_<float> >&clusterZ, vector<vector<int> >& clusterIndices);
+	static void partition(const cv::Mat& Y, int minSize, vector<int>& indices, vector<cv::Range>& clusters);
+	static void partition(const cv::Mat& Y, int minSize, vector<int>& indices, vector<cv::Range>& clusters, vector<PartitionNode>& nodes);
+	static int route(const vector<PartitionNode>& nodes, const float* y, int cols);
+	static cv::Mat permute(const cv::Mat& X, const vector<int>& indices);
+	static double kmeans(const cv::Mat_<float>& Y, int attempts, int maxIterations, cv::Mat_<int>& labels, cv::Mat_<float>& centroids);
+	static double twoMeans(const cv::Mat_<float>& Y, unsigned seed, int maxIterations, cv::Mat_<int>& labels, cv::Mat_<float>& centroids);
+
+private:
+	static void partition(cv::Mat_<float>& samples, vector<int>& indices, int start, int end, int minSize, vector<cv::Range>& clusters, vector<PartitionNode>& nodes);
+	static double assign(const cv::Mat_<float>& Y, const cv::Mat_<float>& centroids, cv::Mat_<int>& labels);
 };
 
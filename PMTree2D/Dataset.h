@@ -0,0 +1,20 @@
+#pragma once
+
+#include <opencv/cv.h>
+
+/**
+ * Training data for the inverse mapping.
+ * Each row of X is a set of PM parameters, and the same row of Y is its high-level indicators (without the constant term).
+ */
+class Dataset {
+public:
+	cv::Mat_<double> X;
+	cv::Mat_<double> Y;
+
+public:
+	Dataset() {}
+	Dataset(const cv::Mat_<double>& X, const cv::Mat_<double>& Y) : X(X), Y(Y) {}
+
+	int size() const { return X.rows; }
+};
+
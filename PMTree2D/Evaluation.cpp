@@ -0,0 +1,99 @@
+﻿#include "Evaluation.h"
+
+/**
+ * 正規化された推定値を元のスケールに戻しながら、各列のRMSEを正規化/元のスケールの両方で計算する。
+ * 全サンプルを1パスで処理し、サンプルごとの一時行列は作らない。
+ *
+ * @param X2_hat		正規化された推定値 (各行が、各サンプルを表す)
+ * @param X				真のPMパラメータ (各行が、各サンプルを表す)
+ * @param muX			PMパラメータの平均
+ * @param maxX			PMパラメータの正規化に使った最大値
+ * @param X_hat [OUT]	推定したPMパラメータ (元のスケール)
+ * @param error [OUT]	各列の正規化されたRMSE
+ * @param error2 [OUT]	各列のRMSE
+ */
+void Evaluation::rmse(const cv::Mat_<double>& X2_hat, const cv::Mat_<double>& X, const cv::Mat_<double>& muX, const cv::Mat_<double>& maxX, cv::Mat_<double>& X_hat, cv::Mat_<double>& error, cv::Mat_<double>& error2) {
+	int N = X.rows;
+	int M = X.cols;
+
+	X_hat.create(N, M);
+	error = cv::Mat_<double>::zeros(1, M);
+	error2 = cv::Mat_<double>::zeros(1, M);
+	const double* mu = muX[0];
+	const double* scale = maxX[0];
+	double* e = error[0];
+	double* e2 = error2[0];
+	for (int r = 0; r < N; ++r) {
+		const double* x = X[r];
+		const double* x2_hat = X2_hat[r];
+		double* x_hat = X_hat[r];
+		for (int c = 0; c < M; ++c) {
+			x_hat[c] = x2_hat[c] * scale[c] + mu[c];
+			double diff = x[c] - x_hat[c];
+			double diff2 = diff / scale[c];
+			e[c] += diff2 * diff2;
+			e2[c] += diff * diff;
+		}
+	}
+
+	for (int c = 0; c < M; ++c) {
+		e[c] = sqrt(e[c] / N);
+		e2[c] = sqrt(e2[c] / N);
+	}
+}
+
+/**
+ * 元のスケールの推定値について、各列のRMSEを正規化/元のスケールの両方で計算する。
+ * 正規化されたエラーは、(x - x_hat) / maxX から求める。
+ *
+ * @param X_hat			推定したPMパラメータ (各行が、各サンプルを表す)
+ * @param X				真のPMパラメータ (各行が、各サンプルを表す)
+ * @param maxX			PMパラメータの正規化に使った最大値
+ * @param error [OUT]	各列の正規化されたRMSE
+ * @param error2 [OUT]	各列のRMSE
+ */
+void Evaluation::rmse(const cv::Mat_<double>& X_hat, const cv::Mat_<double>& X, const cv::Mat_<double>& maxX, cv::Mat_<double>& error, cv::Mat_<double>& error2) {
+	int N = X.rows;
+	int M = X.cols;
+
+	error = cv::Mat_<double>::zeros(1, M);
+	error2 = cv::Mat_<double>::zeros(1, M);
+	double* e = error[0];
+	double* e2 = error2[0];
+	for (int r = 0; r < N; ++r) {
+		const double* x = X[r];
+		const double* x_hat = X_hat[r];
+		for (int c = 0; c < M; ++c) {
+			double diff = x[c] - x_hat[c];
+			double diff2 = diff / maxX(0, c);
+			e[c] += diff2 * diff2;
+			e2[c] += diff * diff;
+		}
+	}
+
+	for (int c = 0; c < M; ++c) {
+		e[c] = sqrt(e[c] / N);
+		e2[c] = sqrt(e2[c] / N);
+	}
+}
+
+/**
+ * エラーと、推定にかかった時間を表示する。
+ */
+void Evaluation::print(const cv::Mat_<double>& error, const cv::Mat_<double>& error2, double seconds) {
+	cout << "Prediction error (normalized):" << endl;
+	cout << error << endl;
+	cout << "Prediction error:" << endl;
+	cout << error2 << endl;
+	cout << "Prediction time: " << seconds << " sec" << endl;
+}
+
+/**
+ * startTickからの経過時間を秒で返却する。
+ *
+ * @param startTick		cv::getTickCount()で取得した開始時刻
+ * @return				経過時間 [sec]
+ */
+double Evaluation::seconds(int64 startTick) {
+	return (double)(cv::getTickCount() - startTick) / cv::getTickFrequency();
+}
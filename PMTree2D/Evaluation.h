@@ -0,0 +1,18 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+
+using namespace std;
+
+class Evaluation {
+protected:
+	Evaluation() {}
+
+public:
+	static void rmse(const cv::Mat_<double>& X2_hat, const cv::Mat_<double>& X, const cv::Mat_<double>& muX, const cv::Mat_<double>& maxX, cv::Mat_<double>& X_hat, cv::Mat_<double>& error, cv::Mat_<double>& error2);
+	static void rmse(const cv::Mat_<double>& X_hat, const cv::Mat_<double>& X, const cv::Mat_<double>& maxX, cv::Mat_<double>& error, cv::Mat_<double>& error2);
+	static void print(const cv::Mat_<double>& error, const cv::Mat_<double>& error2, double seconds);
+	static double seconds(int64 startTick);
+};
+
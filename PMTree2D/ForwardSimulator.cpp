@@ -0,0 +1,129 @@
+﻿#include "ForwardSimulator.h"
+
+/**
+ * 複数のPMパラメータから、並列に木を生成して統計情報を計算する。
+ * 各スレッドは自分のPMTree2Dをheadlessで使うので、OpenGLのコンテキストは不要。
+ */
+class TreeSimulator : public cv::ParallelLoopBody {
+private:
+	const cv::Mat_<double>& P;
+	cv::Mat_<double>& S;
+	cv::Mat_<uchar>& valid;
+	int statistics;
+
+public:
+	TreeSimulator(const cv::Mat_<double>& P, cv::Mat_<double>& S, cv::Mat_<uchar>& valid, int statistics) : P(P), S(S), valid(valid), statistics(statistics) {}
+
+	void operator()(const cv::Range& range) const {
+		PMTree2D tree;
+		tree.headless = true;
+		for (int r = range.start; r < range.end; ++r) {
+			cv::Mat_<float> params;
+			P.row(r).convertTo(params, CV_32F);
+			tree.setParams(params);
+			valid(r, 0) = tree.generate() ? 1 : 0;
+
+			// 物理的にNGの場合は、ヒストグラムが計算されないので0とする
+			if (!valid(r, 0)) {
+				S.row(r).setTo(0.0);
+				continue;
+			}
+
+			vector<float> stats = tree.getStatistics(statistics);
+			for (int c = 0; c < S.cols; ++c) {
+				S(r, c) = stats[c];
+			}
+		}
+	}
+};
+
+/**
+ * PMパラメータから木を生成して、統計情報を計算する。
+ *
+ * @param params		PMパラメータ (行ベクトル)
+ * @param stats [OUT]	統計情報 (行ベクトル)
+ * @param statistics	統計情報の種類 (PMTree2D::getStatistics()を参照)
+ * @return				true - 物理的にOK / false - 物理的にNG
+ */
+bool ForwardSimulator::simulate(const cv::Mat_<double>& params, cv::Mat_<double>& stats, int statistics) {
+	cv::Mat_<uchar> valid;
+	simulate(params, stats, valid, statistics);
+
+	return valid(0, 0) != 0;
+}
+
+/**
+ * 複数のPMパラメータから、並列に木を生成して統計情報を計算する。
+ * generate()は毎回同じシードで乱数を初期化するので、同じPMパラメータからは同じ統計情報が得られる。
+ *
+ * @param P				PMパラメータ (各行が、各サンプルを表す)
+ * @param S [OUT]		統計情報 (各行が、各サンプルに対応する)
+ * @param valid [OUT]	各サンプルが物理的にOKかどうか (列ベクトル)
+ * @param statistics	統計情報の種類 (PMTree2D::getStatistics()を参照)
+ */
+void ForwardSimulator::simulate(const cv::Mat_<double>& P, cv::Mat_<double>& S, cv::Mat_<uchar>& valid, int statistics) {
+	S.create(P.rows, PMTree2D::numStatistics(statistics));
+	valid.create(P.rows, 1);
+	cv::parallel_for_(cv::Range(0, P.rows), TreeSimulator(P, S, valid, statistics));
+}
+
+/**
+ * 統計情報 (getStatistics3()) のPMパラメータに関するヤコビ行列 (15 x 14) を、中心差分で計算する。
+ * 各パラメータを±h動かした28本と元のパラメータの1本を、まとめて並列に生成する。
+ * generate()は毎回同じシードで乱数を初期化するので、全ての生成が共通の乱数列を使い、
+ * 差分では乱数によるばらつきが打ち消される。
+ *
+ * 刻み幅hは、各パラメータの範囲のrelStep倍とする。ただし、整数値のパラメータは1以上とする。
+ * 片側が物理的にNGの場合は、元のパラメータとの片側差分を使う。
+ *
+ * @param params		PMパラメータ (行ベクトル)
+ * @param relStep		刻み幅 (パラメータの範囲に対する比率)
+ * @param J [OUT]		ヤコビ行列 (J(i, j) = dS_i / dP_j)
+ * @param stats [OUT]	元のパラメータでの統計情報 (行ベクトル)
+ * @return				true - 元のパラメータが物理的にOK / false - 物理的にNG
+ */
+bool ForwardSimulator::jacobian(const cv::Mat_<double>& params, double relStep, cv::Mat_<double>& J, cv::Mat_<double>& stats) {
+	int n = params.cols;
+
+	vector<float> lower, upper;
+	PMTree2D::getParamRange(lower, upper);
+
+	// 各パラメータを+h, -hしたものと、元のパラメータを並べる
+	vector<double> h(n);
+	cv::Mat_<double> P = cv::repeat(params, 2 * n + 1, 1);
+	for (int j = 0; j < n; ++j) {
+		h[j] = relStep * (upper[j] - lower[j]);
+		if (PMTree2D::isIntegerParam(j)) h[j] = max(h[j], 1.0);
+
+		P(2 * j, j) += h[j];
+		P(2 * j + 1, j) -= h[j];
+	}
+
+	cv::Mat_<double> S;
+	cv::Mat_<uchar> valid;
+	simulate(P, S, valid);
+	stats = S.row(2 * n).clone();
+
+	J = cv::Mat_<double>::zeros(S.cols, n);
+	for (int j = 0; j < n; ++j) {
+		bool plus = valid(2 * j, 0) != 0;
+		bool minus = valid(2 * j + 1, 0) != 0;
+		bool center = valid(2 * n, 0) != 0;
+
+		cv::Mat_<double> d;
+		if (plus && minus) {
+			d = (S.row(2 * j) - S.row(2 * j + 1)) / (2.0 * h[j]);
+		} else if (plus && center) {
+			d = (S.row(2 * j) - S.row(2 * n)) / h[j];
+		} else if (minus && center) {
+			d = (S.row(2 * n) - S.row(2 * j + 1)) / h[j];
+		} else {
+			continue;
+		}
+
+		cv::Mat_<double> col = J.col(j);
+		cv::Mat_<double>(d.t()).copyTo(col);
+	}
+
+	return valid(2 * n, 0) != 0;
+}
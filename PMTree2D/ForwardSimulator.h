@@ -0,0 +1,15 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include "PMTree2D.h"
+
+class ForwardSimulator {
+protected:
+	ForwardSimulator() {}
+
+public:
+	static bool simulate(const cv::Mat_<double>& params, cv::Mat_<double>& stats, int statistics = 3);
+	static void simulate(const cv::Mat_<double>& P, cv::Mat_<double>& S, cv::Mat_<uchar>& valid, int statistics = 3);
+	static bool jacobian(const cv::Mat_<double>& params, double relStep, cv::Mat_<double>& J, cv::Mat_<double>& stats);
+};
+
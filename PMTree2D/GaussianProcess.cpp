@@ -1,57 +1,977 @@
 ﻿#include "GaussianProcess.h"
+#include <random>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * 共分散行列を、行ごとに並列に計算する。
+ */
+class CovarianceMatrixBuilder : public cv::ParallelLoopBody {
+private:
+	const GaussianProcess* gp;
+	const cv::Mat_<double>& X;
+	cv::Mat_<double>& cov;
+
+public:
+	CovarianceMatrixBuilder(const GaussianProcess* gp, const cv::Mat_<double>& X, cv::Mat_<double>& cov) : gp(gp), X(X), cov(cov) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int r = range.start; r < range.end; ++r) {
+			for (int c = 0; c <= r; ++c) {
+				cov(r, c) = gp->covariance_function(X.row(r), X.row(c));
+			}
+		}
+	}
+};
+
+/**
+ * クエリ群と学習データとの共分散行列 K_* (各行が、各クエリに対応する) を、行ごとに並列に計算する。
+ */
+class CrossCovarianceBuilder : public cv::ParallelLoopBody {
+private:
+	const GaussianProcess* gp;
+	const cv::Mat_<double>& Xq;
+	const cv::Mat_<double>& X;
+	cv::Mat_<double>& cov;
+
+public:
+	CrossCovarianceBuilder(const GaussianProcess* gp, const cv::Mat_<double>& Xq, const cv::Mat_<double>& X, cv::Mat_<double>& cov) : gp(gp), Xq(Xq), X(X), cov(cov) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int r = range.start; r < range.end; ++r) {
+			for (int c = 0; c < X.rows; ++c) {
+				cov(r, c) = gp->covariance_function(Xq.row(r), X.row(c));
+			}
+		}
+	}
+};
+
+/**
+ * クエリのブロックごとに、V = L^-1 K_*^T を解いて予測分散を並列に計算する。
+ * 各ブロックは、1回の三角行列の求解で済む。
+ */
+class VarianceSolver : public cv::ParallelLoopBody {
+private:
+	const GaussianProcess* gp;
+	const cv::Mat_<double>& Xq;
+	const cv::Mat_<double>& K;
+	cv::Mat_<double>& variance;
+	int blockSize;
+
+public:
+	VarianceSolver(const GaussianProcess* gp, const cv::Mat_<double>& Xq, const cv::Mat_<double>& K, cv::Mat_<double>& variance, int blockSize) : gp(gp), Xq(Xq), K(K), variance(variance), blockSize(blockSize) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int b = range.start; b < range.end; ++b) {
+			int start = b * blockSize;
+			int end = min(start + blockSize, Xq.rows);
+
+			cv::Mat_<double> V = K.rowRange(start, end).t();
+			gp->solveLower(V);
+			cv::Mat_<double> v2;
+			cv::reduce(V.mul(V), v2, 0, CV_REDUCE_SUM);
+
+			for (int q = start; q < end; ++q) {
+				variance(q, 0) = max(gp->covariance_function(Xq.row(q), Xq.row(q)) - v2(0, q - start), 0.0);
+			}
+		}
+	}
+};
+
+/**
+ * ファイル上のタイル行列に、共分散行列の下三角部分をタイルごとに並列に計算する。
+ */
+class TiledCovarianceBuilder : public cv::ParallelLoopBody {
+private:
+	const GaussianProcess* gp;
+	const cv::Mat_<double>& X;
+	TiledMatrix& cov;
+	double beta_inv;
+
+public:
+	TiledCovarianceBuilder(const GaussianProcess* gp, const cv::Mat_<double>& X, TiledMatrix& cov, double beta_inv) : gp(gp), X(X), cov(cov), beta_inv(beta_inv) {}
+
+	void operator()(const cv::Range& range) const {
+		int tileSize = cov.getTileSize();
+		for (int t = range.start; t < range.end; ++t) {
+			// 通し番号tから、タイルの行番号iと列番号jを求める
+			int i = (int)((sqrt(8.0 * t + 1.0) - 1.0) / 2.0);
+			while (i * (i + 1) / 2 > t) --i;
+			while ((i + 1) * (i + 2) / 2 <= t) ++i;
+			int j = t - i * (i + 1) / 2;
+
+			int N = cov.rows();
+			cv::Mat_<double> tile(min(tileSize, N - i * tileSize), min(tileSize, N - j * tileSize));
+			for (int r = 0; r < tile.rows; ++r) {
+				for (int c = 0; c < tile.cols; ++c) {
+					tile(r, c) = gp->covariance_function(X.row(i * tileSize + r), X.row(j * tileSize + c));
+				}
+				if (i == j) tile(r, r) += beta_inv;
+			}
+			cov.setTile(i, j, tile);
+		}
+	}
+};
+
+/**
+ * 共分散行列を保持せずに、C = Cov B をブロック行ごとに並列に計算する。
+ */
+class CovarianceMultiplier : public cv::ParallelLoopBody {
+private:
+	const GaussianProcess* gp;
+	const cv::Mat_<double>& X;
+	const cv::Mat_<double>& B;
+	cv::Mat_<double>& C;
+	double beta_inv;
+
+public:
+	CovarianceMultiplier(const GaussianProcess* gp, const cv::Mat_<double>& X, const cv::Mat_<double>& B, cv::Mat_<double>& C, double beta_inv) : gp(gp), X(X), B(B), C(C), beta_inv(beta_inv) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int r = range.start; r < range.end; ++r) {
+			double* Cr = C[r];
+			for (int m = 0; m < C.cols; ++m) {
+				Cr[m] = beta_inv * B(r, m);
+			}
+			for (int c = 0; c < X.rows; ++c) {
+				double k = gp->covariance_function(X.row(r), X.row(c));
+				const double* Bc = B[c];
+				for (int m = 0; m < C.cols; ++m) {
+					Cr[m] += k * Bc[m];
+				}
+			}
+		}
+	}
+};
+
+/**
+ * 複数の初期値からのhyperparameterの最適化を、並列に実行する。
+ */
+class GaussianProcessOptimizer : public cv::ParallelLoopBody {
+private:
+	const cv::Mat_<double>& X;
+	const cv::Mat_<double>& Y;
+	vector<cv::Mat_<double> >& params;
+	vector<double>& likelihoods;
+	int maxIterations;
+
+public:
+	GaussianProcessOptimizer(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, vector<cv::Mat_<double> >& params, vector<double>& likelihoods, int maxIterations) : X(X), Y(Y), params(params), likelihoods(likelihoods), maxIterations(maxIterations) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int i = range.start; i < range.end; ++i) {
+			likelihoods[i] = GaussianProcess::optimizeFrom(X, Y, params[i], maxIterations);
+		}
+	}
+};
 
 /**
  * ガウス過程を初期化する。
+ * paramsを省略した場合、hyperparameterは初期値のままなので、必要に応じてoptimize()を呼ぶこと。
+ * paramsを指定した場合は、その値で1回だけ分解する (後からsetHyperparameters()を呼ぶと、分解が2回になる)。
+ *
+ * tileFileを指定した場合は、共分散行列をメモリに保持せず、
+ * ファイル上のタイル行列に格納して分解する (データ数がメモリに載らないほど大きい場合用)。
+ *
+ * @param X				データ群 (各行が、各データx_iを表す)
+ * @param Y				観測データ群 (各行が、各観測データy_iを表す)
+ * @param tileFile		タイル行列を格納するファイル名 (空ならメモリ上で分解する)
+ * @param tileSize		タイルのサイズ
+ * @param params		hyperparameter (対数、空なら初期値)
+ */
+GaussianProcess::GaussianProcess(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, const std::string& tileFile, int tileSize, const cv::Mat_<double>& params) {
+	init(X, Y);
+	this->tileFile = tileFile;
+	this->tileSize = tileSize;
+	if (!params.empty()) setParams(params);
+
+	factorize();
+}
+
+/**
+ * 共分散行列を分解せず、前処理付き共役勾配法でalpha = Cov^-1 Y を解くガウス過程を初期化する。
+ * 共分散行列とベクトルの積は毎回計算し直すので、メモリはO(N)で済む。
+ * 残差がcgToleranceを下回るか、反復回数がcgMaxIterationsに達したら打ち切る。
+ * コレスキー因子を持たないので、予測分散付きのpredictBatch()、addSample()、removeSample()は使えない。
+ *
+ * @param X					データ群 (各行が、各データx_iを表す)
+ * @param Y					観測データ群 (各行が、各観測データy_iを表す)
+ * @param cgTolerance		相対残差の許容値
+ * @param cgMaxIterations	最大反復回数
+ * @param cgRank			前処理に使うpivoted Cholesky分解のランク
+ * @param params			hyperparameter (対数、空なら初期値)
+ */
+GaussianProcess::GaussianProcess(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, double cgTolerance, int cgMaxIterations, int cgRank, const cv::Mat_<double>& params) {
+	init(X, Y);
+	this->cgTolerance = cgTolerance;
+	this->cgMaxIterations = cgMaxIterations;
+	this->cgRank = cgRank;
+	if (!params.empty()) setParams(params);
+
+	factorize();
+}
+
+/**
+ * 学習済みのhyperparameterとalpha = Cov^-1 Y から、ガウス過程を復元する。
+ * 共分散行列の計算と分解はしないので、すぐに推定 (predict、predictBatch) に使える。
+ * ただし、因子Lを持たないので、addSample()、removeSample()は使えない。
+ *
+ * @param X			データ群 (各行が、各データx_iを表す)
+ * @param params	hyperparameter (対数)
+ * @param alpha		Cov^-1 Y
+ */
+GaussianProcess::GaussianProcess(const cv::Mat_<double>& X, const cv::Mat_<double>& params, const cv::Mat_<double>& alpha) {
+	init(X, cv::Mat_<double>());
+	this->alpha = alpha.clone();
+	setParams(params);
+}
+
+/**
+ * 対数周辺尤度を最大化するように、hyperparameterを最適化する。
+ * 複数の初期値から並列に勾配法を実行し、最も尤度の高い結果を採用する。
+ * データ数がmaxSamplesを超える場合は、ランダムに選んだサブセットで最適化する。
  *
- * @param X		データ群 (各行が、各データx_iを表す)
+ * @param numStarts			初期値の数
+ * @param maxIterations		各初期値からの最大反復回数
+ * @param maxSamples		最適化に使用する最大データ数
  */
-GaussianProcess::GaussianProcess(const cv::Mat_<double>& X) {
-	// データ数
+void GaussianProcess::optimize(int numStarts, int maxIterations, int maxSamples) {
 	int N = X.rows;
+	int D = X.cols;
 
-	// hyperparameterを適当にセットする
-	theta_0 = 1.0;
-	theta_1 = 16.0;
-	theta_2 = 0.0;
-	theta_3 = 0.0;
+	std::mt19937 mt(0);
 
-	// Covを計算する
-	cv::Mat_<double> cov(N, N);
+	// サブセットを選ぶ
+	cv::Mat_<double> subX, subY;
+	if (N > maxSamples) {
+		vector<int> indices(N);
+		for (int i = 0; i < N; ++i) indices[i] = i;
+		for (int i = N - 1; i > 0; --i) {
+			std::uniform_int_distribution<int> u(0, i);
+			swap(indices[i], indices[u(mt)]);
+		}
+
+		subX.create(maxSamples, D);
+		subY.create(maxSamples, Y.cols);
+		for (int i = 0; i < maxSamples; ++i) {
+			X.row(indices[i]).copyTo(subX.row(i));
+			Y.row(indices[i]).copyTo(subY.row(i));
+		}
+	} else {
+		subX = X;
+		subY = Y;
+	}
+
+	// 初期値 (1つ目は現在の値、残りはランダム)
+	vector<cv::Mat_<double> > params(numStarts);
+	params[0] = getHyperparameters();
+	std::uniform_real_distribution<> r(0.0, 1.0);
+	for (int s = 1; s < numStarts; ++s) {
+		params[s] = cv::Mat_<double>(1, D + 4);
+		params[s](0, 0) = log(0.1) + r(mt) * log(100.0);
+		double scale = log(0.5) + r(mt) * log(128.0);
+		for (int d = 0; d < D; ++d) {
+			params[s](0, d + 1) = scale + (r(mt) - 0.5);
+		}
+		params[s](0, D + 1) = log(1.0e-4) + r(mt) * log(1.0e4);
+		params[s](0, D + 2) = log(1.0e-4) + r(mt) * log(1.0e4);
+		params[s](0, D + 3) = log(1.0e-4) + r(mt) * log(1.0e3);
+	}
+
+	vector<double> likelihoods(numStarts);
+	cv::parallel_for_(cv::Range(0, numStarts), GaussianProcessOptimizer(subX, subY, params, likelihoods, maxIterations));
+
+	int best = max_element(likelihoods.begin(), likelihoods.end()) - likelihoods.begin();
+	std::cout << "Log marginal likelihood: " << likelihoods[best] << std::endl;
+
+	setHyperparameters(params[best]);
+}
+
+/**
+ * 学習済みのガウス過程に、データを1つ追加する。
+ * コレスキー因子を1行拡張するだけなので、O(N^2)で済む。
+ * hyperparameterは変更しない。メモリ上でコレスキー分解している場合のみ使用できる。
+ *
+ * @param x		データ (行ベクトル)
+ * @param y		観測データ (行ベクトル)
+ */
+void GaussianProcess::addSample(const cv::Mat_<double>& x, const cv::Mat_<double>& y) {
+	CV_Assert(!L.empty());
+
+	int N = X.rows;
+
+	// 新しい行 l = L^-1 k と、対角要素 d を計算する
+	cv::Mat_<double> l(N, 1);
 	for (int r = 0; r < N; ++r) {
-		for (int c = 0; c < N; ++c) {
-			std::cout << ".";
-			cov(r, c) = covariance_function(X.row(r), X.row(c));
+		l(r, 0) = covariance_function(X.row(r), x);
+	}
+	forwardSubstitution(L, l);
+	double d2 = covariance_function(x, x) + 1.0 / beta - l.dot(l);
+	double d = sqrt(max(d2, 1.0 / beta));
+
+	resizeFactor(N + 1);
+	for (int c = 0; c < N; ++c) {
+		L(N, c) = l(c, 0);
+	}
+	L(N, N) = d;
+
+	// V = L^-1 Y も1行拡張する
+	cv::Mat_<double> v = (y - l.t() * V) / d;
+
+	X.push_back(x);
+	Y.push_back(y);
+	V.push_back(v);
+
+	alpha = V.clone();
+	backSubstitution(L, alpha);
+}
+
+/**
+ * 学習済みのガウス過程から、index番目のデータを削除する。
+ * 削除した行より後ろのブロックをrank-one updateするだけなので、O(N^2)で済む。
+ * メモリ上でコレスキー分解している場合のみ使用できる。
+ *
+ * @param index		削除するデータのindex番号
+ */
+void GaussianProcess::removeSample(int index) {
+	CV_Assert(!L.empty());
+
+	int N = X.rows;
+
+	// 後ろのブロック L33 を、L33 L33^T + l32 l32^T となるように更新する
+	cv::Mat_<double> x(N, 1, 0.0);
+	for (int r = index + 1; r < N; ++r) {
+		x(r, 0) = L(r, index);
+	}
+	for (int k = index + 1; k < N; ++k) {
+		double r = sqrt(L(k, k) * L(k, k) + x(k, 0) * x(k, 0));
+		double c = r / L(k, k);
+		double s = x(k, 0) / L(k, k);
+		L(k, k) = r;
+		for (int j = k + 1; j < N; ++j) {
+			L(j, k) = (L(j, k) + s * x(j, 0)) / c;
+			x(j, 0) = c * x(j, 0) - s * L(j, k);
+		}
+	}
+
+	// index番目の行と列を詰める
+	for (int r = index + 1; r < N; ++r) {
+		const double* src = L[r];
+		double* dst = L[r - 1];
+		for (int c = 0; c < index; ++c) {
+			dst[c] = src[c];
+		}
+		for (int c = index + 1; c <= r; ++c) {
+			dst[c - 1] = src[c];
 		}
 	}
+	resizeFactor(N - 1);
 
-	invCov = cov.inv(cv::DECOMP_SVD);
+	cv::Mat_<double> tailX = X.rowRange(index + 1, N).clone();
+	cv::Mat_<double> tailY = Y.rowRange(index + 1, N).clone();
+	tailX.copyTo(X.rowRange(index, N - 1));
+	tailY.copyTo(Y.rowRange(index, N - 1));
+	X.pop_back();
+	Y.pop_back();
+
+	V = Y.clone();
+	forwardSubstitution(L, V);
+	alpha = V.clone();
+	backSubstitution(L, alpha);
+}
+
+/**
+ * 学習データの数を返却する。
+ */
+int GaussianProcess::size() const {
+	return X.rows;
+}
+
+/**
+ * 学習データ群を返却する。
+ */
+const cv::Mat_<double>& GaussianProcess::getX() const {
+	return X;
+}
+
+/**
+ * alpha = Cov^-1 Y を返却する。
+ */
+const cv::Mat_<double>& GaussianProcess::getAlpha() const {
+	return alpha;
 }
 
 /**
  * ガウス過程により、指定されたデータxに対応する値を推定する。
  *
  * @param x		データ (行ベクトル)
- * @param X		データ群 (各行が、各データx_iを表す)
- * @param Y		観測データ群 (各行が、各観測データy_iを表す)
  * @return		推定された値（行ベクトル）
  */
-cv::Mat_<double> GaussianProcess::predict(const cv::Mat_<double>& x, const cv::Mat_<double>& X, const cv::Mat_<double>& Y) {
-	cv::Mat_<double> k(Y.rows, 1);
-	for (int r = 0; r < k.rows; ++r) {
-		k(r, 0) = covariance_function(X.row(r), x);
+cv::Mat_<double> GaussianProcess::predict(const cv::Mat_<double>& x) {
+	cv::Mat_<double> k(1, X.rows);
+	for (int r = 0; r < X.rows; ++r) {
+		k(0, r) = covariance_function(X.row(r), x);
 	}
 
-	return k.t() * invCov * Y;
+	return k * alpha;
+}
+
+/**
+ * 複数のデータに対応する値を、まとめて推定する。
+ * 共分散 K_* を並列に計算し、K_* alpha の1回の行列積で推定する。
+ *
+ * @param Xq	データ群 (各行が、各データx_iを表す)
+ * @return		推定された値 (各行が、各データに対応する)
+ */
+cv::Mat_<double> GaussianProcess::predictBatch(const cv::Mat_<double>& Xq) const {
+	cv::Mat_<double> K(Xq.rows, X.rows);
+	cv::parallel_for_(cv::Range(0, Xq.rows), CrossCovarianceBuilder(this, Xq, X, K));
+
+	return K * alpha;
+}
+
+/**
+ * 複数のデータに対応する値と、潜在関数の予測分散を、まとめて推定する。
+ * v = L^-1 k_* とすると、分散は k(x, x) - v^T v となる。
+ * 共分散 K_* は推定値と共有し、V = L^-1 K_*^T はblockSize個のクエリごとに並列に解く。
+ * コレスキー分解している場合 (メモリ上、タイル行列のどちらも) のみ使用できる (共役勾配法では使えない)。
+ *
+ * @param Xq				データ群 (各行が、各データx_iを表す)
+ * @param variance [OUT]	予測分散 (列ベクトル)
+ * @param blockSize			1回の三角行列の求解で扱うクエリ数
+ * @return					推定された値 (各行が、各データに対応する)
+ */
+cv::Mat_<double> GaussianProcess::predictBatch(const cv::Mat_<double>& Xq, cv::Mat_<double>& variance, int blockSize) const {
+	CV_Assert(!L.empty() || !tiledL.empty());
+
+	cv::Mat_<double> K(Xq.rows, X.rows);
+	cv::parallel_for_(cv::Range(0, Xq.rows), CrossCovarianceBuilder(this, Xq, X, K));
+
+	variance.create(Xq.rows, 1);
+	int numBlocks = (Xq.rows + blockSize - 1) / blockSize;
+	cv::parallel_for_(cv::Range(0, numBlocks), VarianceSolver(this, Xq, K, variance, blockSize));
+
+	return K * alpha;
+}
+
+/**
+ * 指定されたデータxでの、潜在関数の予測分散を計算する。
+ *
+ * @param x		データ (行ベクトル)
+ * @return		予測分散
+ */
+double GaussianProcess::variance(const cv::Mat_<double>& x) const {
+	cv::Mat_<double> var;
+	predictBatch(x, var);
+
+	return var(0, 0);
 }
 
 /**
  * 共分散を定義する関数。
+ * theta_1は各次元ごとの重み (ARD) である。
  *
  * @param x1
  * @param x2
  * @return		共分散
  */
-double GaussianProcess::covariance_function(const cv::Mat_<double>& x1, const cv::Mat_<double>& x2) {
-	double n = cv::norm(x1 - x2);
-	return theta_0 * exp(-theta_1 / 2.0 * n * n) + theta_2 + theta_3 * x1.dot(x2);
+double GaussianProcess::covariance_function(const cv::Mat_<double>& x1, const cv::Mat_<double>& x2) const {
+	double n2 = 0.0;
+	double dot = 0.0;
+	for (int i = 0; i < x1.cols; ++i) {
+		double diff = x1(0, i) - x2(0, i);
+		n2 += theta_1(0, i) * diff * diff;
+		dot += x1(0, i) * x2(0, i);
+	}
+	return theta_0 * exp(-0.5 * n2) + theta_2 + theta_3 * dot;
+}
+
+/**
+ * hyperparameterを、対数空間の行ベクトルとして返却する。
+ * 並びは、theta_0, theta_1 (各次元), theta_2, theta_3, 1/betaの順。
+ *
+ * @return		hyperparameter (対数)
+ */
+cv::Mat_<double> GaussianProcess::getHyperparameters() const {
+	int D = theta_1.cols;
+
+	cv::Mat_<double> params(1, D + 4);
+	params(0, 0) = log(theta_0);
+	for (int d = 0; d < D; ++d) {
+		params(0, d + 1) = log(theta_1(0, d));
+	}
+	params(0, D + 1) = log(max(theta_2, 1.0e-6));
+	params(0, D + 2) = log(max(theta_3, 1.0e-6));
+	params(0, D + 3) = log(1.0 / beta);
+
+	return params;
+}
+
+/**
+ * 対数空間のhyperparameterをセットし、共分散行列を分解し直す。
+ *
+ * @param params	hyperparameter (対数)
+ */
+void GaussianProcess::setHyperparameters(const cv::Mat_<double>& params) {
+	setParams(params);
+	factorize();
+}
+
+/**
+ * 対数空間のhyperparameterをセットする。共分散行列は分解しない。
+ *
+ * @param params	hyperparameter (対数)
+ */
+void GaussianProcess::setParams(const cv::Mat_<double>& params) {
+	int D = params.cols - 4;
+
+	theta_0 = exp(params(0, 0));
+	theta_1 = cv::Mat_<double>(1, D);
+	for (int d = 0; d < D; ++d) {
+		theta_1(0, d) = exp(params(0, d + 1));
+	}
+	theta_2 = exp(params(0, D + 1));
+	theta_3 = exp(params(0, D + 2));
+	beta = exp(-params(0, D + 3));
+}
+
+/**
+ * 対数周辺尤度と、対数空間のhyperparameterに関するその勾配を計算する。
+ * Yの各列は、共通のカーネルを持つ独立なガウス過程とみなす。
+ *
+ * @param X				データ群 (各行が、各データx_iを表す)
+ * @param Y				観測データ群 (各行が、各観測データy_iを表す)
+ * @param params		hyperparameter (対数)
+ * @param grad [OUT]	勾配
+ * @return				対数周辺尤度 (共分散行列が正定値でない場合は、-DBL_MAX)
+ */
+double GaussianProcess::logMarginalLikelihood(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, const cv::Mat_<double>& params, cv::Mat_<double>& grad) {
+	int N = X.rows;
+	int D = X.cols;
+	int M = Y.cols;
+
+	double t0 = exp(params(0, 0));
+	cv::Mat_<double> t1(1, D);
+	for (int d = 0; d < D; ++d) {
+		t1(0, d) = exp(params(0, d + 1));
+	}
+	double t2 = exp(params(0, D + 1));
+	double t3 = exp(params(0, D + 2));
+	double beta_inv = exp(params(0, D + 3));
+
+	grad = cv::Mat_<double>::zeros(1, D + 4);
+
+	// 共分散行列を計算する
+	cv::Mat_<double> K_rbf(N, N);
+	cv::Mat_<double> K_dot = X * X.t();
+	for (int r = 0; r < N; ++r) {
+		for (int c = 0; c <= r; ++c) {
+			double n2 = 0.0;
+			for (int d = 0; d < D; ++d) {
+				double diff = X(r, d) - X(c, d);
+				n2 += t1(0, d) * diff * diff;
+			}
+			K_rbf(r, c) = t0 * exp(-0.5 * n2);
+			K_rbf(c, r) = K_rbf(r, c);
+		}
+	}
+	cv::Mat_<double> cov = K_rbf + t2 + t3 * K_dot + beta_inv * cv::Mat_<double>::eye(N, N);
+
+	cv::Mat_<double> L;
+	if (!cholesky(cov, L)) return -DBL_MAX;
+
+	cv::Mat_<double> alpha = Y.clone();
+	forwardSubstitution(L, alpha);
+	backSubstitution(L, alpha);
+
+	double lml = -0.5 * Y.dot(alpha) - 0.5 * N * M * log(2.0 * CV_PI);
+	for (int i = 0; i < N; ++i) {
+		lml -= M * log(L(i, i));
+	}
+
+	// 勾配は 1/2 tr((alpha alpha^T - M Cov^-1) dCov/dtheta)
+	cv::Mat_<double> invCov = cv::Mat_<double>::eye(N, N);
+	forwardSubstitution(L, invCov);
+	backSubstitution(L, invCov);
+	cv::Mat_<double> W = alpha * alpha.t() - M * invCov;
+
+	for (int r = 0; r < N; ++r) {
+		for (int c = 0; c < N; ++c) {
+			double w = W(r, c) * K_rbf(r, c);
+			grad(0, 0) += w;
+			for (int d = 0; d < D; ++d) {
+				double diff = X(r, d) - X(c, d);
+				grad(0, d + 1) -= 0.5 * w * t1(0, d) * diff * diff;
+			}
+			grad(0, D + 1) += W(r, c) * t2;
+			grad(0, D + 2) += W(r, c) * t3 * K_dot(r, c);
+		}
+		grad(0, D + 3) += W(r, r) * beta_inv;
+	}
+	grad *= 0.5;
+
+	return lml;
+}
+
+/**
+ * 指定された初期値から、Rpropにより対数周辺尤度を最大化する。
+ *
+ * @param X					データ群 (各行が、各データx_iを表す)
+ * @param Y					観測データ群 (各行が、各観測データy_iを表す)
+ * @param params [IN/OUT]	hyperparameter (対数)
+ * @param maxIterations		最大反復回数
+ * @return					対数周辺尤度
+ */
+double GaussianProcess::optimizeFrom(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, cv::Mat_<double>& params, int maxIterations) {
+	const double minLog = log(1.0e-6);
+	const double maxLog = log(1.0e4);
+
+	int P = params.cols;
+	cv::Mat_<double> grad;
+	cv::Mat_<double> prevGrad = cv::Mat_<double>::zeros(1, P);
+	cv::Mat_<double> delta(1, P, 0.1);
+	cv::Mat_<double> bestParams = params.clone();
+	double best = -DBL_MAX;
+
+	for (int iter = 0; iter < maxIterations; ++iter) {
+		double lml = logMarginalLikelihood(X, Y, params, grad);
+		if (lml == -DBL_MAX) {
+			// 正定値でなくなったら、最良の値に戻ってノイズを増やす
+			bestParams.copyTo(params);
+			params(0, P - 1) = min(params(0, P - 1) + 1.0, maxLog);
+			delta *= 0.5;
+			prevGrad = 0.0;
+			continue;
+		}
+		if (lml > best) {
+			best = lml;
+			params.copyTo(bestParams);
+		}
+
+		bool converged = true;
+		for (int p = 0; p < P; ++p) {
+			double s = grad(0, p) * prevGrad(0, p);
+			if (s > 0) {
+				delta(0, p) = min(delta(0, p) * 1.2, 1.0);
+			} else if (s < 0) {
+				delta(0, p) = max(delta(0, p) * 0.5, 1.0e-6);
+				grad(0, p) = 0.0;
+			}
+
+			if (grad(0, p) > 0) {
+				params(0, p) = min(params(0, p) + delta(0, p), maxLog);
+			} else if (grad(0, p) < 0) {
+				params(0, p) = max(params(0, p) - delta(0, p), minLog);
+			}
+
+			if (delta(0, p) > 1.0e-4) converged = false;
+		}
+		grad.copyTo(prevGrad);
+
+		if (converged) break;
+	}
+
+	bestParams.copyTo(params);
+	return best;
+}
+
+/**
+ * 対称正定値行列Aを、A = L L^Tとコレスキー分解する。
+ *
+ * @param A				対称正定値行列 (下三角部分のみ使用する)
+ * @param L [OUT]		下三角行列
+ * @return				true - 成功 / false - 正定値でない
+ */
+bool GaussianProcess::cholesky(const cv::Mat_<double>& A, cv::Mat_<double>& L) {
+	int N = A.rows;
+	L = cv::Mat_<double>::zeros(N, N);
+
+	for (int j = 0; j < N; ++j) {
+		double* Lj = L[j];
+		double s = A(j, j);
+		for (int k = 0; k < j; ++k) {
+			s -= Lj[k] * Lj[k];
+		}
+		if (s <= 0) return false;
+		Lj[j] = sqrt(s);
+
+		for (int i = j + 1; i < N; ++i) {
+			double* Li = L[i];
+			double t = A(i, j);
+			for (int k = 0; k < j; ++k) {
+				t -= Li[k] * Lj[k];
+			}
+			Li[j] = t / Lj[j];
+		}
+	}
+
+	return true;
+}
+
+/**
+ * L Z = B を解き、BをZで上書きする。
+ *
+ * @param L				下三角行列
+ * @param B [IN/OUT]	右辺 (N x M)
+ */
+void GaussianProcess::forwardSubstitution(const cv::Mat_<double>& L, cv::Mat_<double>& B) {
+	for (int i = 0; i < B.rows; ++i) {
+		const double* Li = L[i];
+		double* Bi = B[i];
+		for (int k = 0; k < i; ++k) {
+			const double* Bk = B[k];
+			for (int m = 0; m < B.cols; ++m) {
+				Bi[m] -= Li[k] * Bk[m];
+			}
+		}
+		for (int m = 0; m < B.cols; ++m) {
+			Bi[m] /= Li[i];
+		}
+	}
+}
+
+/**
+ * L^T Z = B を解き、BをZで上書きする。
+ *
+ * @param L				下三角行列
+ * @param B [IN/OUT]	右辺 (N x M)
+ */
+void GaussianProcess::backSubstitution(const cv::Mat_<double>& L, cv::Mat_<double>& B) {
+	for (int i = B.rows - 1; i >= 0; --i) {
+		const double* Li = L[i];
+		double* Bi = B[i];
+		for (int m = 0; m < B.cols; ++m) {
+			Bi[m] /= Li[i];
+		}
+		for (int k = 0; k < i; ++k) {
+			double* Bk = B[k];
+			for (int m = 0; m < B.cols; ++m) {
+				Bk[m] -= Li[k] * Bi[m];
+			}
+		}
+	}
+}
+
+/**
+ * 学習データとhyperparameterの初期値をセットする。
+ */
+void GaussianProcess::init(const cv::Mat_<double>& X, const cv::Mat_<double>& Y) {
+	this->X = X.clone();
+	this->Y = Y.clone();
+	tileSize = 0;
+	cgTolerance = 0.0;
+	cgMaxIterations = 0;
+	cgRank = 0;
+
+	// hyperparameterの初期値 (ARDなので、theta_1は各次元ごとに持つ)
+	theta_0 = 1.0;
+	theta_1 = cv::Mat_<double>(1, X.cols, 16.0);
+	theta_2 = 0.0;
+	theta_3 = 0.0;
+	beta = 1.0e6;
+}
+
+/**
+ * 共分散行列を計算してコレスキー分解し、alpha = Cov^-1 Y を計算する。
+ * 正定値にならない場合は、ノイズを増やして分解し直す。
+ */
+void GaussianProcess::factorize() {
+	if (!tileFile.empty()) {
+		factorizeOutOfCore();
+		return;
+	}
+	if (cgMaxIterations > 0) {
+		solveByConjugateGradient();
+		return;
+	}
+
+	int N = X.rows;
+
+	cv::Mat_<double> cov(N, N);
+	cv::parallel_for_(cv::Range(0, N), CovarianceMatrixBuilder(this, X, cov));
+
+	while (true) {
+		for (int i = 0; i < N; ++i) {
+			cov(i, i) = covariance_function(X.row(i), X.row(i)) + 1.0 / beta;
+		}
+		if (cholesky(cov, L)) break;
+
+		beta *= 0.1;
+		std::cout << "Covariance matrix is not positive definite. 1/beta is increased to " << 1.0 / beta << std::endl;
+	}
+
+	V = Y.clone();
+	forwardSubstitution(L, V);
+	alpha = V.clone();
+	backSubstitution(L, alpha);
+}
+
+/**
+ * 共分散行列をファイル上のタイル行列に計算してブロックコレスキー分解し、
+ * alpha = Cov^-1 Y を計算する。メモリ上には、O(N)のデータしか保持しない。
+ * 正定値にならない場合は、ノイズを増やして分解し直す。
+ */
+void GaussianProcess::factorizeOutOfCore() {
+	int N = X.rows;
+
+	L.release();
+	if (tiledL.empty() || tiledL->rows() != N) {
+		tiledL.release();
+		tiledL = new TiledMatrix(tileFile, N, tileSize);
+	}
+
+	int numTiles = tiledL->getNumTiles();
+	while (true) {
+		cv::parallel_for_(cv::Range(0, numTiles * (numTiles + 1) / 2), TiledCovarianceBuilder(this, X, *tiledL, 1.0 / beta));
+		if (tiledL->cholesky()) break;
+
+		beta *= 0.1;
+		std::cout << "Covariance matrix is not positive definite. 1/beta is increased to " << 1.0 / beta << std::endl;
+	}
+
+	V = Y.clone();
+	tiledL->forwardSubstitution(V);
+	alpha = V.clone();
+	tiledL->backSubstitution(alpha);
+}
+
+/**
+ * 前処理付き共役勾配法により、alpha = Cov^-1 Y を計算する。Yの各列を同時に解く。
+ * 前処理行列には、共分散行列のランクcgRankのpivoted Cholesky分解 P P^T に、
+ * 残りの対角成分を足したものを使い、その逆行列はWoodburyの公式で適用する。
+ */
+void GaussianProcess::solveByConjugateGradient() {
+	int N = X.rows;
+	int M = Y.cols;
+	int R = min(cgRank, N);
+
+	L.release();
+	tiledL.release();
+	V.release();
+
+	// pivoted Cholesky分解
+	cv::Mat_<double> P = cv::Mat_<double>::zeros(N, R);
+	cv::Mat_<double> diag(N, 1);
+	for (int i = 0; i < N; ++i) {
+		diag(i, 0) = covariance_function(X.row(i), X.row(i));
+	}
+	for (int j = 0; j < R; ++j) {
+		cv::Point pivot;
+		double maxDiag;
+		cv::minMaxLoc(diag, NULL, &maxDiag, NULL, &pivot);
+		if (maxDiag <= 1.0e-12) {
+			R = j;
+			P = P.colRange(0, R).clone();
+			break;
+		}
+
+		double s = sqrt(maxDiag);
+		for (int i = 0; i < N; ++i) {
+			double t = covariance_function(X.row(i), X.row(pivot.y));
+			for (int m = 0; m < j; ++m) {
+				t -= P(i, m) * P(pivot.y, m);
+			}
+			P(i, j) = t / s;
+			diag(i, 0) = max(diag(i, 0) - P(i, j) * P(i, j), 0.0);
+		}
+	}
+
+	// 前処理行列 (P P^T + D)^-1 = D^-1 - D^-1 P (I + P^T D^-1 P)^-1 P^T D^-1
+	cv::Mat_<double> invD = 1.0 / (diag + 1.0 / beta);
+	cv::Mat_<double> invDP = P.clone();
+	for (int i = 0; i < N; ++i) {
+		invDP.row(i) *= invD(i, 0);
+	}
+	cv::Mat_<double> invC;
+	if (R > 0) invC = (cv::Mat_<double>::eye(R, R) + P.t() * invDP).inv(cv::DECOMP_CHOLESKY);
+
+	// 共役勾配法
+	alpha = cv::Mat_<double>::zeros(N, M);
+	cv::Mat_<double> res = Y.clone();
+	cv::Mat_<double> z = res.mul(cv::repeat(invD, 1, M));
+	if (R > 0) z -= invDP * (invC * (invDP.t() * res));
+	cv::Mat_<double> p = z.clone();
+	cv::Mat_<double> q(N, M);
+
+	vector<double> rz(M), normY(M);
+	vector<bool> converged(M, false);
+	for (int m = 0; m < M; ++m) {
+		rz[m] = res.col(m).dot(z.col(m));
+		normY[m] = max(cv::norm(Y.col(m)), 1.0e-12);
+	}
+
+	for (int iter = 0; iter < cgMaxIterations; ++iter) {
+		multiplyCovariance(p, q);
+
+		for (int m = 0; m < M; ++m) {
+			if (converged[m]) continue;
+
+			double a = rz[m] / p.col(m).dot(q.col(m));
+			alpha.col(m) += a * p.col(m);
+			res.col(m) -= a * q.col(m);
+
+			double residual = cv::norm(res.col(m)) / normY[m];
+			if (residual < cgTolerance) converged[m] = true;
+		}
+		if (find(converged.begin(), converged.end(), false) == converged.end()) break;
+
+		z = res.mul(cv::repeat(invD, 1, M));
+		if (R > 0) z -= invDP * (invC * (invDP.t() * res));
+		for (int m = 0; m < M; ++m) {
+			if (converged[m]) continue;
+
+			double rz_new = res.col(m).dot(z.col(m));
+			cv::Mat_<double> pm = p.col(m);
+			pm = z.col(m) + (rz_new / rz[m]) * pm;
+			rz[m] = rz_new;
+		}
+	}
+}
+
+/**
+ * コレスキー因子Lを使って、L Z = B を解き、BをZで上書きする。
+ * メモリ上とタイル行列のどちらで分解していても使える。
+ *
+ * @param B [IN/OUT]	右辺 (N x M)
+ */
+void GaussianProcess::solveLower(cv::Mat_<double>& B) const {
+	if (!L.empty()) {
+		forwardSubstitution(L, B);
+	} else {
+		tiledL->forwardSubstitution(B);
+	}
+}
+
+/**
+ * 共分散行列を保持せずに、C = Cov B を計算する。
+ *
+ * @param B			右から掛ける行列 (N x M)
+ * @param C [OUT]	結果 (N x M)
+ */
+void GaussianProcess::multiplyCovariance(const cv::Mat_<double>& B, cv::Mat_<double>& C) const {
+	C.create(B.rows, B.cols);
+	cv::parallel_for_(cv::Range(0, X.rows), CovarianceMultiplier(this, X, B, C, 1.0 / beta));
+}
+
+/**
+ * コレスキー因子Lのサイズをn x nに変更する。
+ * データの追加のたびにコピーしなくて済むよう、容量が足りない場合は倍のサイズのバッファを確保する。
+ *
+ * @param n		新しいサイズ
+ */
+void GaussianProcess::resizeFactor(int n) {
+	cv::Size wholeSize;
+	cv::Point ofs;
+	L.locateROI(wholeSize, ofs);
+
+	if (wholeSize.height >= n && wholeSize.width >= n) {
+		L.adjustROI(0, n - L.rows, 0, n - L.cols);
+	} else {
+		int m = min(L.rows, n);
+		cv::Mat_<double> buf = cv::Mat_<double>::zeros(max(n, L.rows * 2), max(n, L.rows * 2));
+		L(cv::Rect(0, 0, m, m)).copyTo(buf(cv::Rect(0, 0, m, m)));
+		L = buf(cv::Rect(0, 0, n, n));
+	}
 }
@@ -2,18 +2,62 @@
 
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
+#include <string>
+#include "TiledMatrix.h"
 
 class GaussianProcess {
+	friend class VarianceSolver;
+
 private:
-	float theta_0;
-	float theta_1;
-	float theta_2;
-	float theta_3;
-	cv::Mat_<double> invCov;
+	double theta_0;
+	cv::Mat_<double> theta_1;
+	double theta_2;
+	double theta_3;
+	double beta;
+	cv::Mat_<double> X;
+	cv::Mat_<double> Y;
+	cv::Mat_<double> L;
+	cv::Mat_<double> V;
+	cv::Mat_<double> alpha;
+	std::string tileFile;
+	int tileSize;
+	cv::Ptr<TiledMatrix> tiledL;
+	double cgTolerance;
+	int cgMaxIterations;
+	int cgRank;
 
 public:
-	GaussianProcess(const cv::Mat_<double>& X);
-	cv::Mat_<double> predict(const cv::Mat_<double>& x, const cv::Mat_<double>& X, const cv::Mat_<double>& Y);
-	double covariance_function(const cv::Mat_<double>& x1, const cv::Mat_<double>& x2);
+	GaussianProcess(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, const std::string& tileFile = "", int tileSize = 256, const cv::Mat_<double>& params = cv::Mat_<double>());
+	GaussianProcess(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, double cgTolerance, int cgMaxIterations, int cgRank, const cv::Mat_<double>& params = cv::Mat_<double>());
+	GaussianProcess(const cv::Mat_<double>& X, const cv::Mat_<double>& params, const cv::Mat_<double>& alpha);
+	void optimize(int numStarts, int maxIterations, int maxSamples);
+	void addSample(const cv::Mat_<double>& x, const cv::Mat_<double>& y);
+	void removeSample(int index);
+	int size() const;
+	const cv::Mat_<double>& getX() const;
+	const cv::Mat_<double>& getAlpha() const;
+	cv::Mat_<double> predict(const cv::Mat_<double>& x);
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Xq) const;
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Xq, cv::Mat_<double>& variance, int blockSize = 64) const;
+	double variance(const cv::Mat_<double>& x) const;
+	double covariance_function(const cv::Mat_<double>& x1, const cv::Mat_<double>& x2) const;
+	cv::Mat_<double> getHyperparameters() const;
+	void setHyperparameters(const cv::Mat_<double>& params);
+
+	static double logMarginalLikelihood(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, const cv::Mat_<double>& params, cv::Mat_<double>& grad);
+	static double optimizeFrom(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, cv::Mat_<double>& params, int maxIterations);
+	static bool cholesky(const cv::Mat_<double>& A, cv::Mat_<double>& L);
+	static void forwardSubstitution(const cv::Mat_<double>& L, cv::Mat_<double>& B);
+	static void backSubstitution(const cv::Mat_<double>& L, cv::Mat_<double>& B);
+
+private:
+	void init(const cv::Mat_<double>& X, const cv::Mat_<double>& Y);
+	void setParams(const cv::Mat_<double>& params);
+	void factorize();
+	void factorizeOutOfCore();
+	void solveByConjugateGradient();
+	void solveLower(cv::Mat_<double>& B) const;
+	void multiplyCovariance(const cv::Mat_<double>& B, cv::Mat_<double>& C) const;
+	void resizeFactor(int n);
 };
 
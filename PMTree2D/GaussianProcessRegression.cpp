@@ -0,0 +1,138 @@
+﻿#include "GaussianProcessRegression.h"
+
+/**
+ * ガウス過程によるinverseマッピング。
+ * hyperparameterは、学習時に対数周辺尤度を最大化するように最適化する (GaussianProcess::optimize()を参照)。
+ *
+ * @param numStarts			最適化の初期値の数
+ * @param maxIterations		各初期値からの最大反復回数
+ * @param maxSamples		最適化に使用する最大データ数
+ */
+GaussianProcessRegression::GaussianProcessRegression(int numStarts, int maxIterations, int maxSamples) {
+	this->numStarts = numStarts;
+	this->maxIterations = maxIterations;
+	this->maxSamples = maxSamples;
+	this->tileSize = 256;
+	this->cgTolerance = 1.0e-3;
+	this->cgMaxIterations = 0;
+	this->cgRank = 100;
+}
+
+/**
+ * hyperparameterを固定する。fit()では最適化せずに、この値を使う (交差検証のグリッドサーチ用)。
+ * theta_1は、全ての次元で共通の値とする。
+ */
+void GaussianProcessRegression::setHyperparameters(double theta_0, double theta_1, double theta_2, double theta_3, double beta) {
+	fixedParams = (cv::Mat_<double>(1, 5) << theta_0, theta_1, theta_2, theta_3, beta);
+}
+
+/**
+ * 共分散行列をメモリに保持せず、ファイル上のタイル行列に格納して分解する (データ数が大きい場合用)。
+ * hyperparameterの最適化は、maxSamples個のサブセットに対してメモリ上で行う。
+ *
+ * @param tileFile		タイル行列を格納するファイル名 (空ならメモリ上で分解する)
+ * @param tileSize		タイルのサイズ
+ */
+void GaussianProcessRegression::setOutOfCore(const std::string& tileFile, int tileSize) {
+	this->tileFile = tileFile;
+	this->tileSize = tileSize;
+}
+
+/**
+ * 共分散行列を分解せず、前処理付き共役勾配法でalphaを解く (GaussianProcessのコンストラクタを参照)。
+ * コレスキー因子を持たないので、予測分散付きのpredictBatch()は使えない。
+ * setOutOfCore()と両方指定した場合は、こちらを優先する。
+ *
+ * @param tolerance			相対残差の許容値
+ * @param maxIterations		最大反復回数
+ * @param rank				前処理に使うpivoted Cholesky分解のランク
+ */
+void GaussianProcessRegression::setConjugateGradient(double tolerance, int maxIterations, int rank) {
+	this->cgTolerance = tolerance;
+	this->cgMaxIterations = maxIterations;
+	this->cgRank = rank;
+}
+
+/**
+ * 正規化したhigh-level indicatorからPMパラメータへのガウス過程を学習する。
+ * hyperparameterが固定されていなければ、対数周辺尤度を最大化するように最適化する。
+ *
+ * @param dataset		学習データ
+ */
+void GaussianProcessRegression::fit(const Dataset& dataset) {
+	cv::Mat_<double> X2, Y2;
+	normalize(dataset, X2, Y2);
+
+	// 固定したhyperparameterは、対数空間の並びで構築時に渡し、分解を1回で済ませる (GaussianProcess::getHyperparameters()を参照)
+	cv::Mat_<double> params;
+	if (!fixedParams.empty()) {
+		int D = Y2.cols;
+		params.create(1, D + 4);
+		params(0, 0) = log(fixedParams(0, 0));
+		for (int d = 0; d < D; ++d) {
+			params(0, d + 1) = log(fixedParams(0, 1));
+		}
+		params(0, D + 1) = log(max(fixedParams(0, 2), 1.0e-6));
+		params(0, D + 2) = log(max(fixedParams(0, 3), 1.0e-6));
+		params(0, D + 3) = log(1.0 / fixedParams(0, 4));
+	}
+
+	if (cgMaxIterations > 0) {
+		gp = new GaussianProcess(Y2, X2, cgTolerance, cgMaxIterations, cgRank, params);
+	} else {
+		gp = new GaussianProcess(Y2, X2, tileFile, tileSize, params);
+	}
+	if (fixedParams.empty()) {
+		gp->optimize(numStarts, maxIterations, maxSamples);
+	}
+}
+
+/**
+ * 複数のhigh-level indicatorから、PMパラメータをまとめて推定する。
+ *
+ * @param Y		high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @return		PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> GaussianProcessRegression::predictBatch(const cv::Mat_<double>& Y) const {
+	return denormalizeX(gp->predictBatch(normalizeY(Y)));
+}
+
+/**
+ * 複数のhigh-level indicatorから、PMパラメータと予測分散をまとめて推定する。
+ * 予測分散は正規化したPMパラメータの空間での値で、全ての列で共通である。
+ * 分散が大きいクエリは学習データから離れているので、推定値を信用せずにサンプルを追加するか、
+ * CMAESSolverなどで改善すると良い。
+ * 共分散行列の因子が必要なので、fit()の後のみ使用できる (load()したモデルや、共役勾配法では使えない)。
+ *
+ * @param Y					high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @param variance [OUT]	予測分散 (列ベクトル)
+ * @return					PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> GaussianProcessRegression::predictBatch(const cv::Mat_<double>& Y, cv::Mat_<double>& variance) const {
+	return denormalizeX(gp->predictBatch(normalizeY(Y), variance));
+}
+
+string GaussianProcessRegression::tag() const {
+	return "GP  ";
+}
+
+/**
+ * 学習データ、hyperparameter、alphaを書き出す。
+ * 読み込み時に共分散行列を分解し直さずに済むよう、alphaも保存する。
+ */
+void GaussianProcessRegression::write(ofstream& out) const {
+	writeMat(out, gp->getX());
+	writeMat(out, gp->getHyperparameters());
+	writeMat(out, gp->getAlpha());
+}
+
+/**
+ * write()で書き出したモデルを読み込む。
+ */
+void GaussianProcessRegression::read(ifstream& in) {
+	cv::Mat_<double> X = readMat(in);
+	cv::Mat_<double> params = readMat(in);
+	cv::Mat_<double> alpha = readMat(in);
+
+	gp = new GaussianProcess(X, params, alpha);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "InverseModel.h"
+#include "GaussianProcess.h"
+
+class GaussianProcessRegression : public InverseModel {
+private:
+	int numStarts;
+	int maxIterations;
+	int maxSamples;
+	cv::Mat_<double> fixedParams;
+	std::string tileFile;
+	int tileSize;
+	double cgTolerance;
+	int cgMaxIterations;
+	int cgRank;
+	cv::Ptr<GaussianProcess> gp;
+
+public:
+	GaussianProcessRegression(int numStarts = 8, int maxIterations = 50, int maxSamples = 500);
+
+	void setHyperparameters(double theta_0, double theta_1, double theta_2, double theta_3, double beta);
+	void setOutOfCore(const std::string& tileFile, int tileSize = 256);
+	void setConjugateGradient(double tolerance = 1.0e-3, int maxIterations = 200, int rank = 100);
+	void fit(const Dataset& dataset);
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y) const;
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y, cv::Mat_<double>& variance) const;
+
+protected:
+	string tag() const;
+	void write(ofstream& out) const;
+	void read(ifstream& in);
+};
+
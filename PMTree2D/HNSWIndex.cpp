@@ -0,0 +1,734 @@
+﻿#include "HNSWIndex.h"
+#include <random>
+#include <queue>
+#include <unordered_set>
+#include <algorithm>
+#include <fstream>
+
+using namespace std;
+
+/**
+ * ベクトルを並列にグラフに挿入する。
+ * 各ノードのリンクは、ノードごとのロックで保護する。
+ */
+class HNSWInserter : public cv::ParallelLoopBody {
+private:
+	HNSWIndex* index;
+	int offset;
+	const cv::Mat_<float>& vectors;
+	const cv::Mat_<float>& payloads;
+
+public:
+	HNSWInserter(HNSWIndex* index, int offset, const cv::Mat_<float>& vectors, const cv::Mat_<float>& payloads) : index(index), offset(offset), vectors(vectors), payloads(payloads) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int i = range.start; i < range.end; ++i) {
+			index->insert(offset + i, vectors[i], payloads[i]);
+		}
+	}
+};
+
+/**
+ * 複数のクエリを並列に探索する。
+ */
+class HNSWSearcher : public cv::ParallelLoopBody {
+private:
+	const HNSWIndex* index;
+	const cv::Mat_<float>& queries;
+	int k;
+	cv::Mat_<int>& indices;
+	cv::Mat_<float>& dists;
+
+public:
+	HNSWSearcher(const HNSWIndex* index, const cv::Mat_<float>& queries, int k, cv::Mat_<int>& indices, cv::Mat_<float>& dists) : index(index), queries(queries), k(k), indices(indices), dists(dists) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int r = range.start; r < range.end; ++r) {
+			index->searchOne(queries[r], k, indices[r], dists[r]);
+		}
+	}
+};
+
+/**
+ * 1つのレコードを参照している間、そのセグメントがアンマップされないよう固定する。
+ * レコードは、最上位の層、最下層のリンク (先頭がリンク数)、ベクトル、ペイロードの順に並ぶ。
+ */
+class HNSWRecord {
+private:
+	const HNSWIndex* index;
+	int id;
+	uchar* data;
+
+public:
+	HNSWRecord(const HNSWIndex* index, int id) : index(index), id(id) { data = index->pin(id); }
+	~HNSWRecord() { index->unpin(id); }
+
+	int& level() { return *(int*)data; }
+	int* links() { return (int*)data + 1; }
+	float* vec() { return (float*)(data + sizeof(int) * (2 + index->header.M0)); }
+	float* payload() { return vec() + index->header.dim; }
+
+private:
+	HNSWRecord(const HNSWRecord&);
+	HNSWRecord& operator=(const HNSWRecord&);
+};
+
+/**
+ * 新しいHNSW (Hierarchical Navigable Small World) グラフのインデックスをファイルに作成する。
+ * 最下層のリンク、ベクトル、ペイロード (PMパラメータなど) は、固定長のレコードとしてファイルに置く。
+ * レコードはSEGMENT_RECORDS個ずつのセグメント単位で、使うときにメモリマップし、
+ * マップする量がsetCacheSize()の上限を超える場合は、使われていないセグメントからアンマップする。
+ * そのため、アドレス空間に載り切らないサイズのインデックスも扱える。
+ * 上の層のリンクはノードの数が少ないので、メモリに持ち、addBatch()の最後に別ファイルに書き出す。
+ * ファイルを作成できない場合は、例外 (cv::Exception) を投げる。
+ *
+ * @param fileName			インデックスのファイル名
+ * @param dim				ベクトルの次元数
+ * @param payloadDim		各ベクトルに付随するペイロードの次元数
+ * @param M					上の層での最大リンク数 (最下層では2M)
+ * @param efConstruction	構築時の探索幅
+ */
+HNSWIndex::HNSWIndex(const std::string& fileName, int dim, int payloadDim, int M, int efConstruction) : fileName(fileName), file(QString::fromLocal8Bit(fileName.c_str())) {
+	headerSize = (sizeof(HNSWHeader) + 2 * dim * sizeof(float) + 63) / 64 * 64;
+	recordSize = sizeof(int) * (2 + 2 * M) + sizeof(float) * (dim + payloadDim);
+	levelMult = 1.0 / log((double)M);
+	ef = 50;
+	numMapped = 0;
+	useClock = 0;
+	setCacheSize((qint64)256 * 1024 * 1024);
+
+	memcpy(header.magic, "HNSW", 4);
+	header.dim = dim;
+	header.payloadDim = payloadDim;
+	header.M = M;
+	header.M0 = 2 * M;
+	header.efConstruction = efConstruction;
+	header.count = 0;
+	header.nextSeed = 0;
+	header.capacity = 0;
+	header.entryPoint = -1;
+	header.maxLevel = -1;
+	header.dirty = 0;
+	mu.assign(dim, 0.0f);
+	scale.assign(dim, 1.0f);
+
+	if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+		CV_Error(CV_StsError, "Cannot open the index file " + fileName + ": " + file.errorString().toStdString());
+	}
+	if (!file.resize(headerSize)) {
+		CV_Error(CV_StsError, "Cannot resize the index file " + fileName + ": " + file.errorString().toStdString());
+	}
+	writeHeader();
+
+	nodeLocks = new cv::Mutex[NUM_NODE_LOCKS];
+}
+
+/**
+ * 既存のインデックスファイルを開く。
+ * 開いた後も、addBatch()で追加できる。
+ * 追加の途中で終了したファイルや、上の層のリンクのファイルが欠けている/壊れている場合は、
+ * 整合しないグラフを探索しないよう、例外 (cv::Exception) を投げて開かない。
+ *
+ * @param fileName			インデックスのファイル名
+ */
+HNSWIndex::HNSWIndex(const std::string& fileName) : fileName(fileName), file(QString::fromLocal8Bit(fileName.c_str())) {
+	ef = 50;
+	numMapped = 0;
+	useClock = 0;
+
+	if (!file.open(QIODevice::ReadWrite)) {
+		CV_Error(CV_StsError, "Cannot open the index file " + fileName + ": " + file.errorString().toStdString());
+	}
+	if (file.read((char*)&header, sizeof(HNSWHeader)) != sizeof(HNSWHeader) || memcmp(header.magic, "HNSW", 4) != 0) {
+		CV_Error(CV_StsError, "Not an index file: " + fileName);
+	}
+	if (header.dirty) {
+		CV_Error(CV_StsError, "The index file " + fileName + " was not closed after adding examples");
+	}
+
+	headerSize = (sizeof(HNSWHeader) + 2 * header.dim * sizeof(float) + 63) / 64 * 64;
+	recordSize = sizeof(int) * (2 + header.M0) + sizeof(float) * (header.dim + header.payloadDim);
+	levelMult = 1.0 / log((double)header.M);
+	setCacheSize((qint64)256 * 1024 * 1024);
+	if (header.count < 0 || header.count > header.capacity || header.capacity % SEGMENT_RECORDS != 0 || file.size() < headerSize + (qint64)header.capacity * recordSize) {
+		CV_Error(CV_StsError, "The index file " + fileName + " is truncated");
+	}
+
+	mu.resize(header.dim);
+	scale.resize(header.dim);
+	if (file.read((char*)&mu[0], header.dim * sizeof(float)) != header.dim * sizeof(float) || file.read((char*)&scale[0], header.dim * sizeof(float)) != header.dim * sizeof(float)) {
+		CV_Error(CV_StsError, "The index file " + fileName + " is truncated");
+	}
+
+	segments.resize((header.capacity + SEGMENT_RECORDS - 1) / SEGMENT_RECORDS);
+	upperLinks.resize(header.capacity);
+	readLinks();
+
+	nodeLocks = new cv::Mutex[NUM_NODE_LOCKS];
+}
+
+HNSWIndex::~HNSWIndex() {
+	unmapSegments();
+	file.close();
+	delete [] nodeLocks;
+}
+
+int HNSWIndex::size() const {
+	return header.count;
+}
+
+int HNSWIndex::dims() const {
+	return header.dim;
+}
+
+/**
+ * 次のサンプルの生成に使う乱数のシードを返却する (setNextSeed()を参照)。
+ */
+int HNSWIndex::getNextSeed() const {
+	return header.nextSeed;
+}
+
+/**
+ * 次のサンプルの生成に使う乱数のシードをセットする。
+ * flush()でヘッダと一緒に書き出すので、追加したサンプルとシードが食い違うことはない。
+ *
+ * @param seed		乱数のシード
+ */
+void HNSWIndex::setNextSeed(int seed) {
+	header.nextSeed = seed;
+}
+
+/**
+ * 距離の計算に使う正規化のパラメータをセットする。
+ * ベクトルは、(v - mu) / scale に変換してから格納/探索する。データを追加する前に呼ぶこと。
+ *
+ * @param mu		平均 (行ベクトル)
+ * @param scale		スケール (行ベクトル)
+ */
+void HNSWIndex::setNormalization(const cv::Mat_<float>& mu, const cv::Mat_<float>& scale) {
+	CV_Assert(header.count == 0);
+
+	for (int d = 0; d < header.dim; ++d) {
+		this->mu[d] = mu(0, d);
+		this->scale[d] = scale(0, d) != 0 ? scale(0, d) : 1.0f;
+	}
+	writeHeader();
+}
+
+/**
+ * 探索幅をセットする。大きいほどrecallが上がり、探索は遅くなる。
+ *
+ * @param ef		探索幅 (k以上にすること)
+ */
+void HNSWIndex::setEf(int ef) {
+	this->ef = ef;
+}
+
+/**
+ * 同時にメモリマップしておくレコードの量の上限をセットする。
+ * 探索中のスレッドが参照しているセグメントはアンマップできないので、一時的に超えることがある。
+ *
+ * @param bytes		上限 [bytes]
+ */
+void HNSWIndex::setCacheSize(qint64 bytes) {
+	maxMapped = max(1, (int)(bytes / ((qint64)SEGMENT_RECORDS * recordSize)));
+}
+
+/**
+ * 指定した数のレコードを格納できるよう、ファイルを拡張する。
+ * 容量は、セグメント単位に切り上げる。挿入と並行して呼んではいけない。
+ *
+ * @param capacity		格納できるレコードの数
+ */
+void HNSWIndex::reserve(int capacity) {
+	if (capacity <= header.capacity) return;
+	capacity = (capacity + SEGMENT_RECORDS - 1) / SEGMENT_RECORDS * SEGMENT_RECORDS;
+
+	// マップしたままではファイルを拡張できないので、全てアンマップする
+	unmapSegments();
+	qint64 bytes = headerSize + (qint64)capacity * recordSize;
+	if (!file.resize(bytes)) {
+		CV_Error(CV_StsError, "Cannot resize the index file " + fileName + ": " + file.errorString().toStdString());
+	}
+
+	header.capacity = capacity;
+	segments.resize(capacity / SEGMENT_RECORDS);
+	upperLinks.resize(capacity);
+	writeHeader();
+}
+
+/**
+ * 複数のベクトルを、並列にグラフに挿入する。
+ * 既存のインデックスに、生成したサンプルをバッチごとに追加していける。
+ * 挿入の間はヘッダを追加中の状態にしておき、最後にflush()で上の層のリンクとヘッダを書き出す。
+ * 途中で終了した場合、そのファイルは開けなくなる (作り直す必要がある)。
+ *
+ * @param vectors		ベクトル群 (各行が、各ベクトルを表す)
+ * @param payloads		ペイロード群 (各行が、各ベクトルに対応する)
+ */
+void HNSWIndex::addBatch(const cv::Mat_<float>& vectors, const cv::Mat_<float>& payloads) {
+	CV_Assert(vectors.cols == header.dim && payloads.cols == header.payloadDim && vectors.rows == payloads.rows);
+
+	int offset = header.count;
+	int n = vectors.rows;
+	if (offset + n > header.capacity) {
+		reserve(max(offset + n, header.capacity * 2));
+	}
+
+	header.dirty = 1;
+	writeHeader();
+
+	// 空のグラフでは入口がないので、最初の1つだけは先に挿入する
+	int start = 0;
+	if (offset == 0 && n > 0) {
+		insert(0, vectors[0], payloads[0]);
+		start = 1;
+	}
+	cv::parallel_for_(cv::Range(start, n), HNSWInserter(this, offset, vectors, payloads));
+
+	header.count = offset + n;
+	flush();
+}
+
+/**
+ * 各クエリについて、近いk個のベクトルを並列に探索する。
+ *
+ * @param queries			クエリ群 (各行が、各クエリを表す。正規化前の値)
+ * @param k					近傍の数
+ * @param indices [OUT]		近傍のID (各行が、各クエリに対応する。近い順)
+ * @param dists [OUT]		近傍までの正規化後の二乗距離
+ */
+void HNSWIndex::search(const cv::Mat_<float>& queries, int k, cv::Mat_<int>& indices, cv::Mat_<float>& dists) const {
+	indices = cv::Mat_<int>(queries.rows, k, -1);
+	dists = cv::Mat_<float>(queries.rows, k, FLT_MAX);
+	if (header.count == 0) return;
+
+	cv::parallel_for_(cv::Range(0, queries.rows), HNSWSearcher(this, queries, k, indices, dists));
+}
+
+/**
+ * 指定したIDのペイロードを返却する。
+ */
+cv::Mat_<float> HNSWIndex::payload(int id) const {
+	HNSWRecord r(this, id);
+
+	return cv::Mat_<float>(1, header.payloadDim, r.payload()).clone();
+}
+
+/**
+ * 上の層のリンクを別ファイルに書き出し、ヘッダを追加完了の状態で書き戻す。
+ * 書き出しに失敗した場合は、例外 (cv::Exception) を投げる (ヘッダは追加中の状態のまま)。
+ */
+void HNSWIndex::flush() {
+	ofstream out(linksFileName().c_str(), ios::binary);
+	for (int id = 0; id < header.count; ++id) {
+		if (!upperLinks[id].empty()) {
+			out.write((const char*)&upperLinks[id][0], upperLinks[id].size() * sizeof(int));
+		}
+	}
+	out.close();
+	if (!out) {
+		CV_Error(CV_StsError, "Cannot write " + linksFileName());
+	}
+
+	header.dirty = 0;
+	writeHeader();
+}
+
+/**
+ * 1つのベクトルをグラフに挿入する。
+ * ランダムに決めた層から下の各層で、近傍を探索してリンクを張る。
+ */
+void HNSWIndex::insert(int id, const float* v, const float* p) {
+	int dim = header.dim;
+
+	// レコードを書き込む (ベクトルは正規化して格納する)
+	std::mt19937 mt(id);
+	std::uniform_real_distribution<> u(0.0, 1.0);
+	int l = (int)(-log(1.0 - u(mt)) * levelMult);
+	std::vector<float> x(dim);
+	for (int d = 0; d < dim; ++d) {
+		x[d] = (v[d] - mu[d]) / scale[d];
+	}
+	{
+		HNSWRecord r(this, id);
+		r.level() = l;
+		r.links()[0] = 0;
+		memcpy(r.vec(), &x[0], dim * sizeof(float));
+		memcpy(r.payload(), p, header.payloadDim * sizeof(float));
+	}
+	upperLinks[id].assign(l * (header.M + 1), 0);
+
+	globalLock.lock();
+	int ep = header.entryPoint;
+	int maxLevel = header.maxLevel;
+	if (ep < 0) {
+		header.entryPoint = id;
+		header.maxLevel = l;
+		globalLock.unlock();
+		return;
+	}
+	// 最上層を更新する場合は、挿入が終わるまでロックを保持する
+	if (l <= maxLevel) globalLock.unlock();
+
+	// 上の層は、貪欲法で入口を近づける
+	float d = distance(&x[0], ep);
+	for (int lc = maxLevel; lc > l; --lc) {
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			std::vector<int> nb = neighbors(ep, lc);
+			for (int i = 0; i < nb.size(); ++i) {
+				float dn = distance(&x[0], nb[i]);
+				if (dn < d) {
+					d = dn;
+					ep = nb[i];
+					changed = true;
+				}
+			}
+		}
+	}
+
+	for (int lc = min(l, maxLevel); lc >= 0; --lc) {
+		std::vector<std::pair<float, int> > candidates;
+		searchLayer(&x[0], ep, header.efConstruction, lc, candidates);
+		ep = candidates[0].second;
+
+		selectNeighbors(candidates, header.M);
+
+		{
+			cv::AutoLock lock(nodeLocks[id % NUM_NODE_LOCKS]);
+			HNSWRecord r(this, id);
+			int* ln = lc == 0 ? r.links() : &upperLinks[id][(lc - 1) * (header.M + 1)];
+			ln[0] = candidates.size();
+			for (int i = 0; i < candidates.size(); ++i) {
+				ln[i + 1] = candidates[i].second;
+			}
+		}
+		for (int i = 0; i < candidates.size(); ++i) {
+			connect(candidates[i].second, id, lc);
+		}
+	}
+
+	if (l > maxLevel) {
+		header.entryPoint = id;
+		header.maxLevel = l;
+		globalLock.unlock();
+	}
+}
+
+/**
+ * 1つのクエリについて、近いk個のベクトルを探索する。
+ */
+void HNSWIndex::searchOne(const float* query, int k, int* indices, float* dists) const {
+	int dim = header.dim;
+
+	std::vector<float> q(dim);
+	for (int d = 0; d < dim; ++d) {
+		q[d] = (query[d] - mu[d]) / scale[d];
+	}
+
+	int ep = header.entryPoint;
+	float d = distance(&q[0], ep);
+	for (int lc = header.maxLevel; lc > 0; --lc) {
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			std::vector<int> nb = neighbors(ep, lc);
+			for (int i = 0; i < nb.size(); ++i) {
+				float dn = distance(&q[0], nb[i]);
+				if (dn < d) {
+					d = dn;
+					ep = nb[i];
+					changed = true;
+				}
+			}
+		}
+	}
+
+	std::vector<std::pair<float, int> > result;
+	searchLayer(&q[0], ep, max(ef, k), 0, result);
+	for (int i = 0; i < k && i < result.size(); ++i) {
+		indices[i] = result[i].second;
+		dists[i] = result[i].first;
+	}
+}
+
+/**
+ * ヘッダと正規化のパラメータを、ファイルの先頭に書き込む。
+ */
+void HNSWIndex::writeHeader() {
+	if (!file.seek(0)
+		|| file.write((const char*)&header, sizeof(HNSWHeader)) != sizeof(HNSWHeader)
+		|| file.write((const char*)&mu[0], header.dim * sizeof(float)) != header.dim * sizeof(float)
+		|| file.write((const char*)&scale[0], header.dim * sizeof(float)) != header.dim * sizeof(float)
+		|| !file.flush()) {
+		CV_Error(CV_StsError, "Cannot write the header of " + fileName + ": " + file.errorString().toStdString());
+	}
+}
+
+/**
+ * 上の層のリンクを、別ファイルから読み込む。
+ * ファイルのサイズが、各ノードの層の数から計算したサイズと一致しない場合は、例外を投げる。
+ */
+void HNSWIndex::readLinks() {
+	qint64 total = 0;
+	for (int id = 0; id < header.count; ++id) {
+		int l = level(id);
+		if (l < 0 || l > header.maxLevel) {
+			CV_Error(CV_StsError, "The index file " + fileName + " is corrupted");
+		}
+		upperLinks[id].resize(l * (header.M + 1));
+		total += upperLinks[id].size();
+	}
+	if (total == 0) return;
+
+	ifstream in(linksFileName().c_str(), ios::binary);
+	if (!in) {
+		CV_Error(CV_StsError, "Cannot open " + linksFileName());
+	}
+	in.seekg(0, ios::end);
+	if ((qint64)in.tellg() != total * sizeof(int)) {
+		CV_Error(CV_StsError, linksFileName() + " does not match the index file");
+	}
+	in.seekg(0, ios::beg);
+
+	for (int id = 0; id < header.count; ++id) {
+		if (!upperLinks[id].empty()) {
+			in.read((char*)&upperLinks[id][0], upperLinks[id].size() * sizeof(int));
+		}
+	}
+	if (!in) {
+		CV_Error(CV_StsError, "Cannot read " + linksFileName());
+	}
+}
+
+/**
+ * レコードを含むセグメントを固定し、レコードの先頭を返却する。
+ * マップ済みの場合は、ロックを取らずに参照カウントを増やすだけで済む。
+ * 使い終わったら、unpin()を呼ぶこと (HNSWRecordを参照)。
+ */
+uchar* HNSWIndex::pin(int id) const {
+	HNSWSegment& segment = segments[id / SEGMENT_RECORDS];
+
+	// 先に参照カウントを増やしてから確認するので、確認した後にアンマップされることはない
+	CV_XADD(&segment.pins, 1);
+	uchar* data = segment.data;
+	if (data == NULL) {
+		cv::AutoLock lock(segmentLock);
+		data = segment.data;
+		if (data == NULL) data = mapSegment(id / SEGMENT_RECORDS);
+	}
+	segment.lastUse = useClock;
+
+	return data + (qint64)(id % SEGMENT_RECORDS) * recordSize;
+}
+
+void HNSWIndex::unpin(int id) const {
+	CV_XADD(&segments[id / SEGMENT_RECORDS].pins, -1);
+}
+
+/**
+ * セグメントをメモリマップする (segmentLockを取った状態で呼ぶ)。
+ * 上限に達している場合は、参照されていないセグメントのうち、最も長く使われていないものをアンマップする。
+ */
+uchar* HNSWIndex::mapSegment(int s) const {
+	++useClock;
+	while (numMapped >= maxMapped) {
+		int oldest = -1;
+		for (int i = 0; i < segments.size(); ++i) {
+			if (segments[i].data != NULL && segments[i].pins == 0 && (oldest < 0 || segments[i].lastUse < segments[oldest].lastUse)) {
+				oldest = i;
+			}
+		}
+		if (oldest < 0) break;
+
+		// 先にポインタを消してから参照カウントを確認し、その間に固定された場合は戻す
+		uchar* data = segments[oldest].data;
+		segments[oldest].data = NULL;
+		if (CV_XADD(&segments[oldest].pins, 0) != 0) {
+			segments[oldest].data = data;
+			segments[oldest].lastUse = useClock;
+			continue;
+		}
+		file.unmap(data);
+		--numMapped;
+	}
+
+	qint64 bytes = (qint64)SEGMENT_RECORDS * recordSize;
+	uchar* data = file.map(headerSize + s * bytes, bytes);
+	if (data == NULL) {
+		CV_Error(CV_StsError, "Cannot map the index file " + fileName + ": " + file.errorString().toStdString());
+	}
+	segments[s].data = data;
+	++numMapped;
+
+	return data;
+}
+
+/**
+ * 全てのセグメントをアンマップする。挿入や探索と並行して呼んではいけない。
+ */
+void HNSWIndex::unmapSegments() {
+	for (int i = 0; i < segments.size(); ++i) {
+		if (segments[i].data != NULL) {
+			CV_Assert(segments[i].pins == 0);
+			file.unmap(segments[i].data);
+			segments[i].data = NULL;
+		}
+	}
+	numMapped = 0;
+}
+
+/**
+ * ノードの最上位の層を返却する。
+ */
+int HNSWIndex::level(int id) const {
+	HNSWRecord r(this, id);
+
+	return r.level();
+}
+
+float HNSWIndex::distance(const float* a, const float* b) const {
+	float d2 = 0.0f;
+	for (int d = 0; d < header.dim; ++d) {
+		float diff = a[d] - b[d];
+		d2 += diff * diff;
+	}
+	return d2;
+}
+
+/**
+ * ベクトルaと、ノードidの (正規化された) ベクトルとの二乗距離を返却する。
+ */
+float HNSWIndex::distance(const float* a, int id) const {
+	HNSWRecord r(this, id);
+
+	return distance(a, r.vec());
+}
+
+/**
+ * ノードaとノードbの、(正規化された) ベクトルの二乗距離を返却する。
+ */
+float HNSWIndex::distance(int a, int b) const {
+	HNSWRecord r(this, a);
+
+	return distance(r.vec(), b);
+}
+
+/**
+ * 第l層でのノードのリンク先を、ロックしてコピーする。
+ */
+std::vector<int> HNSWIndex::neighbors(int id, int l) const {
+	cv::AutoLock lock(nodeLocks[id % NUM_NODE_LOCKS]);
+	if (l > 0) {
+		const int* ln = &upperLinks[id][(l - 1) * (header.M + 1)];
+		return std::vector<int>(ln + 1, ln + 1 + ln[0]);
+	}
+
+	HNSWRecord r(this, id);
+	const int* ln = r.links();
+	return std::vector<int>(ln + 1, ln + 1 + ln[0]);
+}
+
+/**
+ * 第l層で、epから貪欲にたどって、qに近いef個のノードを探索する。
+ *
+ * @param q				クエリ (正規化済み)
+ * @param ep			入口のノード
+ * @param ef			探索幅
+ * @param l				層
+ * @param result [OUT]	(二乗距離, ID) のペア (近い順)
+ */
+void HNSWIndex::searchLayer(const float* q, int ep, int ef, int l, std::vector<std::pair<float, int> >& result) const {
+	std::unordered_set<int> visited;
+	std::priority_queue<std::pair<float, int> > top;
+	std::priority_queue<std::pair<float, int>, std::vector<std::pair<float, int> >, std::greater<std::pair<float, int> > > candidates;
+
+	float d = distance(q, ep);
+	visited.insert(ep);
+	top.push(std::make_pair(d, ep));
+	candidates.push(std::make_pair(d, ep));
+
+	while (!candidates.empty()) {
+		std::pair<float, int> c = candidates.top();
+		if (c.first > top.top().first && top.size() >= ef) break;
+		candidates.pop();
+
+		std::vector<int> nb = neighbors(c.second, l);
+		for (int i = 0; i < nb.size(); ++i) {
+			if (!visited.insert(nb[i]).second) continue;
+
+			float dn = distance(q, nb[i]);
+			if (top.size() < ef || dn < top.top().first) {
+				candidates.push(std::make_pair(dn, nb[i]));
+				top.push(std::make_pair(dn, nb[i]));
+				if (top.size() > ef) top.pop();
+			}
+		}
+	}
+
+	result.resize(top.size());
+	for (int i = result.size() - 1; i >= 0; --i) {
+		result[i] = top.top();
+		top.pop();
+	}
+}
+
+/**
+ * 近い順に並んだ候補から、多様な方向のリンクになるよう、最大maxLinks個を選ぶ。
+ * 既に選んだノードの方が候補に近い場合は、その候補は選ばない。
+ *
+ * @param candidates [IN/OUT]	(二乗距離, ID) のペア (近い順)
+ * @param maxLinks				最大リンク数
+ */
+void HNSWIndex::selectNeighbors(std::vector<std::pair<float, int> >& candidates, int maxLinks) const {
+	if (candidates.size() <= maxLinks) return;
+
+	std::vector<std::pair<float, int> > selected;
+	for (int i = 0; i < candidates.size() && selected.size() < maxLinks; ++i) {
+		bool good = true;
+		for (int j = 0; j < selected.size(); ++j) {
+			if (distance(candidates[i].second, selected[j].second) < candidates[i].first) {
+				good = false;
+				break;
+			}
+		}
+		if (good) selected.push_back(candidates[i]);
+	}
+	candidates.swap(selected);
+}
+
+/**
+ * ノードidの第l層に、ノードnへのリンクを追加する。
+ * リンク数が上限を超える場合は、selectNeighbors()で選び直す。
+ */
+void HNSWIndex::connect(int id, int n, int l) {
+	int maxLinks = l == 0 ? header.M0 : header.M;
+
+	cv::AutoLock lock(nodeLocks[id % NUM_NODE_LOCKS]);
+	HNSWRecord r(this, id);
+	int* ln = l == 0 ? r.links() : &upperLinks[id][(l - 1) * (header.M + 1)];
+	if (ln[0] < maxLinks) {
+		ln[++ln[0]] = n;
+		return;
+	}
+
+	const float* x = r.vec();
+	std::vector<std::pair<float, int> > candidates;
+	candidates.push_back(std::make_pair(distance(x, n), n));
+	for (int i = 1; i <= ln[0]; ++i) {
+		candidates.push_back(std::make_pair(distance(x, ln[i]), ln[i]));
+	}
+	std::sort(candidates.begin(), candidates.end());
+	selectNeighbors(candidates, maxLinks);
+
+	ln[0] = candidates.size();
+	for (int i = 0; i < candidates.size(); ++i) {
+		ln[i + 1] = candidates[i].second;
+	}
+}
+
+std::string HNSWIndex::linksFileName() const {
+	return fileName + ".links";
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <QFile>
+#include <string>
+#include <vector>
+
+/**
+ * Header at the top of the file, followed by the normalization mean (dim) and scale (dim).
+ * nextSeed is kept for the caller (the seed to generate the next examples from), so that it is
+ * committed together with the examples.
+ * dirty is set while a batch is being added (the file may be inconsistent).
+ */
+struct HNSWHeader {
+	char magic[4];
+	int dim;
+	int payloadDim;
+	int M;
+	int M0;
+	int efConstruction;
+	int count;
+	int nextSeed;
+	int capacity;
+	int entryPoint;
+	int maxLevel;
+	int dirty;
+};
+
+/**
+ * A group of records that are memory-mapped together.
+ * pins counts the references in use; the segment can be unmapped only when it is 0.
+ */
+struct HNSWSegment {
+	uchar* volatile data;
+	int pins;
+	int lastUse;
+
+	HNSWSegment() : data(NULL), pins(0), lastUse(0) {}
+};
+
+class HNSWIndex {
+	friend class HNSWInserter;
+	friend class HNSWSearcher;
+	friend class HNSWRecord;
+
+private:
+	std::string fileName;
+	mutable QFile file;
+	HNSWHeader header;
+	std::vector<float> mu;
+	std::vector<float> scale;
+	int headerSize;
+	int recordSize;
+	double levelMult;
+	int ef;
+	std::vector<std::vector<int> > upperLinks;
+	mutable std::vector<HNSWSegment> segments;
+	mutable int numMapped;
+	mutable int useClock;
+	int maxMapped;
+	mutable cv::Mutex segmentLock;
+	mutable cv::Mutex globalLock;
+	mutable cv::Mutex* nodeLocks;
+
+	static const int NUM_NODE_LOCKS = 4096;
+	static const int SEGMENT_RECORDS = 16384;
+
+public:
+	HNSWIndex(const std::string& fileName, int dim, int payloadDim, int M = 16, int efConstruction = 200);
+	HNSWIndex(const std::string& fileName);
+	~HNSWIndex();
+
+	int size() const;
+	int dims() const;
+	int getNextSeed() const;
+	void setNextSeed(int seed);
+	void setNormalization(const cv::Mat_<float>& mu, const cv::Mat_<float>& scale);
+	void setEf(int ef);
+	void setCacheSize(qint64 bytes);
+	void reserve(int capacity);
+	void addBatch(const cv::Mat_<float>& vectors, const cv::Mat_<float>& payloads);
+	void search(const cv::Mat_<float>& queries, int k, cv::Mat_<int>& indices, cv::Mat_<float>& dists) const;
+	cv::Mat_<float> payload(int id) const;
+	void flush();
+
+private:
+	void insert(int id, const float* v, const float* p);
+	void searchOne(const float* query, int k, int* indices, float* dists) const;
+	void writeHeader();
+	void readLinks();
+	uchar* pin(int id) const;
+	void unpin(int id) const;
+	uchar* mapSegment(int s) const;
+	void unmapSegments();
+	int level(int id) const;
+	float distance(const float* a, const float* b) const;
+	float distance(const float* a, int id) const;
+	float distance(int a, int b) const;
+	std::vector<int> neighbors(int id, int l) const;
+	void searchLayer(const float* q, int ep, int ef, int l, std::vector<std::pair<float, int> >& result) const;
+	void selectNeighbors(std::vector<std::pair<float, int> >& candidates, int maxLinks) const;
+	void connect(int id, int n, int l);
+	std::string linksFileName() const;
+
+	HNSWIndex(const HNSWIndex&);
+	HNSWIndex& operator=(const HNSWIndex&);
+};
+
@@ -0,0 +1,276 @@
+﻿#include "HierarchicalLR.h"
+
+using namespace std;
+
+/**
+ * 各クラスタのLinear regressionを、それぞれ独立したタスクとして並列に学習する。
+ * 各タスクは自分のクラスタの行範囲と出力先しか触らず、作業用の行列もタスク内で確保する。
+ * 重心までの二乗距離の和と学習誤差は、クラスタごとに書き出して、最後にまとめて足し合わせる。
+ */
+class ClusterRegressor : public cv::ParallelLoopBody {
+private:
+	const cv::Mat_<double>& X2;
+	const cv::Mat_<double>& Y2;
+	const vector<cv::Range>& clusters;
+	vector<cv::Mat_<double> >& W;
+	cv::Mat_<double>& centroids;
+	vector<double>& sumDist2;
+	cv::Mat_<double>& sumError2;
+
+public:
+	ClusterRegressor(const cv::Mat_<double>& X2, const cv::Mat_<double>& Y2, const vector<cv::Range>& clusters, vector<cv::Mat_<double> >& W, cv::Mat_<double>& centroids, vector<double>& sumDist2, cv::Mat_<double>& sumError2) : X2(X2), Y2(Y2), clusters(clusters), W(W), centroids(centroids), sumDist2(sumDist2), sumError2(sumError2) {}
+
+	void operator()(const cv::Range& range) const {
+		cv::Mat_<double> pinv, X2_hat;
+		for (int clu = range.start; clu < range.end; ++clu) {
+			cv::Mat_<double> Yc = Y2.rowRange(clusters[clu]);
+			cv::Mat_<double> Xc = X2.rowRange(clusters[clu]);
+
+			// Linear regressionにより、Wを求める（yW = x より、W = y^+ x)
+			cv::invert(Yc, pinv, cv::DECOMP_SVD);
+			W[clu] = pinv * Xc;
+
+			// クラスタの重心と、重心までの二乗距離の和
+			cv::Mat_<double> c = centroids.row(clu);
+			cv::reduce(Yc, c, 0, CV_REDUCE_AVG);
+			sumDist2[clu] = 0.0;
+			for (int r = 0; r < Yc.rows; ++r) {
+				sumDist2[clu] += cv::norm(Yc.row(r), c, cv::NORM_L2SQR);
+			}
+
+			// 学習データに対する二乗誤差の和
+			cv::gemm(Yc, W[clu], 1.0, Xc, -1.0, X2_hat);
+			cv::Mat_<double> e = sumError2.row(clu);
+			cv::reduce(X2_hat.mul(X2_hat), e, 0, CV_REDUCE_SUM);
+		}
+	}
+};
+
+/**
+ * クラスタごとに振り分けたクエリを、クラスタ単位の行列積で並列に推定する。
+ */
+class LeafPredictor : public cv::ParallelLoopBody {
+private:
+	const cv::Mat_<double>& Y2;
+	const vector<vector<int> >& members;
+	const vector<cv::Mat_<double> >& W;
+	cv::Mat_<double>& X2;
+
+public:
+	LeafPredictor(const cv::Mat_<double>& Y2, const vector<vector<int> >& members, const vector<cv::Mat_<double> >& W, cv::Mat_<double>& X2) : Y2(Y2), members(members), W(W), X2(X2) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int clu = range.start; clu < range.end; ++clu) {
+			if (members[clu].empty()) continue;
+
+			cv::Mat_<double> Yc = DataPartition::permute(Y2, members[clu]);
+			cv::Mat_<double> Xc = Yc * W[clu];
+			for (int i = 0; i < members[clu].size(); ++i) {
+				Xc.row(i).copyTo(X2.row(members[clu][i]));
+			}
+		}
+	}
+};
+
+/**
+ * データを階層的にクラスタリングし、各クラスタについてLinear regressionでマッピング行列Wを計算する。
+ * 分割の木と各クラスタのW、正規化のパラメータを保持するので、
+ * 学習データ以外の新しいhigh-level indicatorからも、PMパラメータを推定できる。
+ *
+ * @param dataset	学習データ
+ */
+void HierarchicalLR::fit(const Dataset& dataset) {
+	int N = dataset.size();
+
+	cv::Mat_<double> dataX2, dataY2;
+	normalize(dataset, dataX2, dataY2);
+
+	// クラスタリングして、各クラスタが連続する行になるよう並べ替える
+	vector<int> indices;
+	vector<cv::Range> clusters;
+	DataPartition::partition(dataY2, minSize, indices, clusters, nodes);
+	cv::Mat_<double> permX2 = DataPartition::permute(dataX2, indices);
+	cv::Mat_<double> permY2 = DataPartition::permute(dataY2, indices);
+
+	for (int clu = 0; clu < clusters.size(); ++clu) {
+		cout << clusters[clu].size() << endl;
+	}
+
+	// 各クラスタについて、並列にLinear regressionでWを求める
+	W.resize(clusters.size());
+	centroids = cv::Mat_<double>(clusters.size(), dataY2.cols);
+	vector<double> clusterDist2(clusters.size());
+	cv::Mat_<double> clusterError2(clusters.size(), dataX2.cols);
+	cv::parallel_for_(cv::Range(0, clusters.size()), ClusterRegressor(permX2, permY2, clusters, W, centroids, clusterDist2, clusterError2));
+
+	// クラスタごとの結果を足し合わせる
+	double sumDist2 = 0.0;
+	for (int clu = 0; clu < clusters.size(); ++clu) {
+		sumDist2 += clusterDist2[clu];
+	}
+	cv::Mat_<double> error;
+	cv::reduce(clusterError2, error, 0, CV_REDUCE_SUM);
+	cv::sqrt(error / N, error);
+
+	cout << "Training error (normalized):" << endl;
+	cout << error << endl;
+
+	// ソフトな重み付けのバンド幅は、クラスタ内の平均二乗距離とする
+	bandwidth = sumDist2 > 0 ? sumDist2 / N : 1.0;
+
+	concatWeights();
+}
+
+/**
+ * 複数のhigh-level indicatorから、PMパラメータをまとめて推定する。
+ * 各行を分割の木で対応するクラスタに振り分け、クラスタごとに1回の行列積で推定する。
+ *
+ * @param Y		high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @return		PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> HierarchicalLR::predictBatch(const cv::Mat_<double>& Y) const {
+	cv::Mat_<double> Y2 = normalizeY(Y);
+	cv::Mat_<float> Y2f;
+	Y2.convertTo(Y2f, CV_32F);
+
+	// クラスタごとに振り分ける
+	vector<vector<int> > members(W.size());
+	for (int r = 0; r < Y2f.rows; ++r) {
+		members[DataPartition::route(nodes, Y2f[r], Y2f.cols)].push_back(r);
+	}
+
+	cv::Mat_<double> X2(Y.rows, muX.cols);
+	cv::parallel_for_(cv::Range(0, W.size()), LeafPredictor(Y2, members, W, X2));
+
+	return denormalizeX(X2);
+}
+
+/**
+ * 複数のhigh-level indicatorから、近いtopK個のクラスタのLinear regressionを
+ * 重心までの距離で重み付けして混合し、PMパラメータをまとめて推定する。
+ * クラスタの境界付近で推定値が不連続になるのを防ぐ。
+ *
+ * 全クエリ・全クラスタについて、重心までの距離と各クラスタの推定値を
+ * それぞれ1回の行列積で計算し、上位topK個だけを混合する。
+ *
+ * @param Y		high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @param topK	混合するクラスタの数 (1なら、最も近い重心のクラスタのみを使う)
+ * @return		PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> HierarchicalLR::predictBatch(const cv::Mat_<double>& Y, int topK) const {
+	int K = W.size();
+	int M = muX.cols;
+	topK = min(topK, K);
+
+	cv::Mat_<double> Y2 = normalizeY(Y);
+
+	// 重心までの二乗距離 |y|^2 + |c|^2 - 2 y c^T
+	cv::Mat_<double> D2;
+	cv::gemm(Y2, centroids, -2.0, cv::noArray(), 0.0, D2, cv::GEMM_2_T);
+	cv::Mat_<double> normY, normC;
+	cv::reduce(Y2.mul(Y2), normY, 1, CV_REDUCE_SUM);
+	cv::reduce(centroids.mul(centroids), normC, 1, CV_REDUCE_SUM);
+	D2 += cv::repeat(normY, 1, K) + cv::repeat(normC.t(), Y2.rows, 1);
+
+	// 全クラスタの推定値 (各行が、K個のクラスタのM次元の推定値を並べたもの)
+	cv::Mat_<double> P = Y2 * Wall;
+
+	cv::Mat_<int> order;
+	cv::sortIdx(D2, order, CV_SORT_EVERY_ROW + CV_SORT_ASCENDING);
+
+	cv::Mat_<double> X2 = cv::Mat_<double>::zeros(Y.rows, M);
+	for (int r = 0; r < Y2.rows; ++r) {
+		const double* d2 = D2[r];
+		const int* o = order[r];
+		const double* p = P[r];
+		double* x = X2[r];
+
+		double total = 0.0;
+		for (int k = 0; k < topK; ++k) {
+			double w = exp(-(d2[o[k]] - d2[o[0]]) / bandwidth);
+			const double* pk = p + o[k] * M;
+			for (int c = 0; c < M; ++c) {
+				x[c] += w * pk[c];
+			}
+			total += w;
+		}
+		for (int c = 0; c < M; ++c) {
+			x[c] /= total;
+		}
+	}
+
+	return denormalizeX(X2);
+}
+
+/**
+ * クラスタの数を返却する。
+ */
+int HierarchicalLR::numClusters() const {
+	return W.size();
+}
+
+string HierarchicalLR::tag() const {
+	return "HLR ";
+}
+
+/**
+ * 分割の木、各クラスタのW、重心、バンド幅を書き出す。
+ */
+void HierarchicalLR::write(ofstream& out) const {
+	out.write((const char*)&minSize, sizeof(int));
+
+	int numNodes = nodes.size();
+	out.write((const char*)&numNodes, sizeof(int));
+	for (int n = 0; n < numNodes; ++n) {
+		out.write((const char*)nodes[n].children, sizeof(int) * 2);
+		out.write((const char*)&nodes[n].cluster, sizeof(int));
+		writeMat(out, nodes[n].centroids);
+	}
+
+	int numW = W.size();
+	out.write((const char*)&numW, sizeof(int));
+	for (int clu = 0; clu < numW; ++clu) {
+		writeMat(out, W[clu]);
+	}
+	writeMat(out, centroids);
+	out.write((const char*)&bandwidth, sizeof(double));
+}
+
+/**
+ * write()で書き出したモデルを読み込む。
+ */
+void HierarchicalLR::read(ifstream& in) {
+	in.read((char*)&minSize, sizeof(int));
+
+	int numNodes = 0;
+	in.read((char*)&numNodes, sizeof(int));
+	nodes.resize(numNodes);
+	for (int n = 0; n < numNodes; ++n) {
+		in.read((char*)nodes[n].children, sizeof(int) * 2);
+		in.read((char*)&nodes[n].cluster, sizeof(int));
+		nodes[n].centroids = readMat(in);
+	}
+
+	int numW = 0;
+	in.read((char*)&numW, sizeof(int));
+	W.resize(numW);
+	for (int clu = 0; clu < numW; ++clu) {
+		W[clu] = readMat(in);
+	}
+	centroids = readMat(in);
+	in.read((char*)&bandwidth, sizeof(double));
+
+	concatWeights();
+}
+
+/**
+ * 各クラスタのWを横に並べて、全クラスタの推定を1回の行列積で計算できるようにする。
+ */
+void HierarchicalLR::concatWeights() {
+	if (W.empty()) {
+		Wall = cv::Mat_<double>();
+		return;
+	}
+
+	cv::hconcat(W, Wall);
+}
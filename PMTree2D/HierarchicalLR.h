@@ -0,0 +1,31 @@
+#pragma once
+
+#include "InverseModel.h"
+#include "DataPartition.h"
+
+class HierarchicalLR : public InverseModel {
+private:
+	int minSize;
+	vector<PartitionNode> nodes;
+	vector<cv::Mat_<double> > W;
+	cv::Mat_<double> centroids;
+	cv::Mat_<double> Wall;
+	double bandwidth;
+
+public:
+	HierarchicalLR(int minSize = 20) : minSize(minSize), bandwidth(1.0) {}
+
+	void fit(const Dataset& dataset);
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y) const;
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y, int topK) const;
+	int numClusters() const;
+
+protected:
+	string tag() const;
+	void write(ofstream& out) const;
+	void read(ifstream& in);
+
+private:
+	void concatWeights();
+};
+
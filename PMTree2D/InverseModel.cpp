@@ -0,0 +1,302 @@
+﻿#include "InverseModel.h"
+#include "LinearRegression.h"
+#include "HierarchicalLR.h"
+#include "GaussianProcessRegression.h"
+#include "KNNRegression.h"
+#include "MLPRegression.h"
+#include "RandomForestRegression.h"
+#include "BaggingRegression.h"
+#include "RandomFourierRegression.h"
+#include <iostream>
+
+/**
+ * high-level indicatorから、PMパラメータを推定する。
+ *
+ * @param y		high-level indicator (行ベクトル。定数項は含まない)
+ * @return		PMパラメータ (行ベクトル)
+ */
+cv::Mat_<double> InverseModel::predict(const cv::Mat_<double>& y) const {
+	return predictBatch(y);
+}
+
+/**
+ * PMパラメータの正規化に使った最大値を返却する。
+ * 正規化されたエラーの計算に使う。
+ */
+const cv::Mat_<double>& InverseModel::getMaxX() const {
+	return maxX;
+}
+
+/**
+ * high-level indicatorのPCA/whiteningを設定する。次のfit()から有効になる。
+ * 統計量の次元が高い場合に、主成分だけに絞ることで、kNNやカーネル法の計算量を減らせる。
+ *
+ * @param energy	残す分散の割合 (0 - 1)。0の場合は、whiteningしない
+ */
+void InverseModel::setWhitening(double energy) {
+	whiteningEnergy = energy;
+}
+
+/**
+ * 学習したPCA/whiteningの変換を返却する (使わない場合は、空)。
+ */
+const Whitening& InverseModel::getWhitening() const {
+	return whitening;
+}
+
+/**
+ * 学習したモデルをバイナリ形式でファイルに保存する。
+ * 先頭に、モデルの種類を表すタグを書き出す。
+ * whiteningを使う場合 (hasWhitening()を参照) は、先頭を"INVW"とし、正規化のパラメータの後に変換を書き出す
+ * (使わない場合は、従来と同じ形式になる)。
+ *
+ * @param fileName		ファイル名
+ * @return				true - 成功 / false - 失敗
+ */
+bool InverseModel::save(const string& fileName) const {
+	ofstream out(fileName.c_str(), ios::binary);
+	if (!out) return false;
+
+	bool whitened = hasWhitening();
+	out.write(whitened ? "INVW" : "INVM", 4);
+	out.write(tag().c_str(), 4);
+	writeMat(out, muX);
+	writeMat(out, maxX);
+	writeMat(out, muY);
+	writeMat(out, maxY);
+	if (whitened) {
+		writeWhitening(out, whitening);
+	}
+	write(out, whitened);
+
+	return out.good();
+}
+
+/**
+ * save()で保存したモデルを読み込む。
+ * ファイルが壊れている場合も、例外を投げずにfalseを返す。
+ *
+ * @param fileName		ファイル名
+ * @return				true - 成功 / false - 失敗 (ファイルがない、種類が違う、または壊れている)
+ */
+bool InverseModel::load(const string& fileName) {
+	ifstream in(fileName.c_str(), ios::binary);
+	if (!in) return false;
+
+	char header[8];
+	in.read(header, 8);
+	if (!in || (strncmp(header, "INVM", 4) != 0 && strncmp(header, "INVW", 4) != 0) || strncmp(header + 4, tag().c_str(), 4) != 0) return false;
+
+	try {
+		muX = readMat(in);
+		maxX = readMat(in);
+		muY = readMat(in);
+		maxY = readMat(in);
+		bool whitened = strncmp(header, "INVW", 4) == 0;
+		if (whitened) {
+			whitening = readWhitening(in);
+		} else {
+			whitening.release();
+		}
+		read(in, whitened);
+	} catch (const std::exception& e) {
+		std::cout << "Cannot load " << fileName << ": " << e.what() << std::endl;
+		return false;
+	}
+
+	return in.good();
+}
+
+/**
+ * save()で保存したモデルを、種類に応じたクラスで読み込む。
+ *
+ * @param fileName		ファイル名
+ * @return				読み込んだモデル (失敗した場合は、空のポインタ)
+ */
+cv::Ptr<InverseModel> InverseModel::open(const string& fileName) {
+	ifstream in(fileName.c_str(), ios::binary);
+	if (!in) return cv::Ptr<InverseModel>();
+
+	char header[8];
+	in.read(header, 8);
+	if (!in || (strncmp(header, "INVM", 4) != 0 && strncmp(header, "INVW", 4) != 0)) return cv::Ptr<InverseModel>();
+	in.close();
+
+	cv::Ptr<InverseModel> model = create(string(header + 4, 4));
+	if (model.empty() || !model->load(fileName)) return cv::Ptr<InverseModel>();
+
+	return model;
+}
+
+/**
+ * タグに対応する種類のモデルを、既定のパラメータで作成する。
+ *
+ * @param tag		モデルの種類を表すタグ (tag()を参照)
+ * @return			作成したモデル (未知のタグの場合は、空のポインタ)
+ */
+cv::Ptr<InverseModel> InverseModel::create(const string& tag) {
+	if (tag == "LR  ") {
+		return new LinearRegression();
+	} else if (tag == "HLR ") {
+		return new HierarchicalLR();
+	} else if (tag == "GP  ") {
+		return new GaussianProcessRegression();
+	} else if (tag == "KNN ") {
+		return new KNNRegression();
+	} else if (tag == "MLP ") {
+		return new MLPRegression();
+	} else if (tag == "RF  ") {
+		return new RandomForestRegression();
+	} else if (tag == "BAG ") {
+		return new BaggingRegression();
+	} else if (tag == "RFF ") {
+		return new RandomFourierRegression();
+	} else {
+		return cv::Ptr<InverseModel>();
+	}
+}
+
+/**
+ * 学習データから正規化のパラメータを計算し、正規化したデータを返却する。
+ * 各列の平均を引いて、[-1, 1]にする (値が一定の列は、0除算にならないようそのままにする)。
+ * Y2には、最後の列に定数項を追加する。
+ * setWhitening()でwhiteningが設定されている場合は、正規化したhigh-level indicatorから
+ * PCA/whiteningの変換も学習する。
+ *
+ * @param dataset		学習データ
+ * @param X2 [OUT]		正規化したPMパラメータ
+ * @param Y2 [OUT]		正規化したhigh-level indicator (最後の列が定数項)
+ */
+void InverseModel::normalize(const Dataset& dataset, cv::Mat_<double>& X2, cv::Mat_<double>& Y2) {
+	int N = dataset.size();
+
+	cv::reduce(dataset.X, muX, 0, CV_REDUCE_AVG);
+	cv::reduce(dataset.Y, muY, 0, CV_REDUCE_AVG);
+	X2 = dataset.X - cv::repeat(muX, N, 1);
+	cv::Mat_<double> dataY2 = dataset.Y - cv::repeat(muY, N, 1);
+
+	cv::reduce(cv::abs(X2), maxX, 0, CV_REDUCE_MAX);
+	cv::reduce(cv::abs(dataY2), maxY, 0, CV_REDUCE_MAX);
+	maxX.setTo(1.0, maxX == 0);
+	maxY.setTo(1.0, maxY == 0);
+	X2 /= cv::repeat(maxX, N, 1);
+
+	whitening.release();
+	if (whiteningEnergy > 0.0) {
+		cv::Mat_<double> dataY3 = normalizeY(dataset.Y);
+		whitening.fit(dataY3.colRange(0, dataY3.cols - 1), whiteningEnergy);
+	}
+
+	Y2 = normalizeY(dataset.Y);
+}
+
+/**
+ * high-level indicatorを[-1, 1]に正規化し、定数項の列を追加する。
+ * whiteningを学習済みの場合は、正規化した後に主成分空間に写像する
+ * (列の数は、主成分の数 + 1になる)。
+ *
+ * @param Y		high-level indicator (各行が、各サンプルを表す)
+ * @return		正規化したhigh-level indicator (最後の列が定数項)
+ */
+cv::Mat_<double> InverseModel::normalizeY(const cv::Mat_<double>& Y) const {
+	cv::Mat_<double> Y2(Y.rows, Y.cols + 1);
+	for (int r = 0; r < Y.rows; ++r) {
+		for (int c = 0; c < Y.cols; ++c) {
+			Y2(r, c) = (Y(r, c) - muY(0, c)) / maxY(0, c);
+		}
+		Y2(r, Y.cols) = 1; // 定数項
+	}
+	if (whitening.empty()) return Y2;
+
+	cv::Mat_<double> Z = whitening.transform(Y2.colRange(0, Y.cols));
+	cv::Mat_<double> Z2;
+	cv::hconcat(Z, cv::Mat_<double>::ones(Z.rows, 1), Z2);
+
+	return Z2;
+}
+
+/**
+ * 正規化されたPMパラメータを、元のスケールに戻す。
+ *
+ * @param X2	正規化されたPMパラメータ (各行が、各サンプルを表す)
+ * @return		PMパラメータ
+ */
+cv::Mat_<double> InverseModel::denormalizeX(const cv::Mat_<double>& X2) const {
+	cv::Mat_<double> X(X2.rows, X2.cols);
+	for (int r = 0; r < X2.rows; ++r) {
+		for (int c = 0; c < X2.cols; ++c) {
+			X(r, c) = X2(r, c) * maxX(0, c) + muX(0, c);
+		}
+	}
+
+	return X;
+}
+
+/**
+ * 保存する形式に、whiteningの変換を含める必要があるかどうかを返却する。
+ */
+bool InverseModel::hasWhitening() const {
+	return !whitening.empty();
+}
+
+/**
+ * 行列をバイナリ形式で書き出す。
+ */
+void InverseModel::writeMat(ofstream& out, const cv::Mat& m) {
+	int header[3] = { m.rows, m.cols, m.type() };
+	out.write((const char*)header, sizeof(header));
+	for (int r = 0; r < m.rows; ++r) {
+		out.write((const char*)m.ptr(r), m.cols * m.elemSize());
+	}
+}
+
+/**
+ * writeMat()で書き出した行列を読み込む。
+ * ファイルが壊れている場合 (サイズが負、CV_32F/CV_64F以外の型、データがファイルの残りより大きい) は、
+ * 確保や読み込みをせずに例外 (cv::Exception) を投げる。
+ */
+cv::Mat InverseModel::readMat(ifstream& in) {
+	int header[3] = { 0, 0, CV_64F };
+	in.read((char*)header, sizeof(header));
+	if (!in || header[0] < 0 || header[1] < 0) {
+		CV_Error(CV_StsParseError, "Invalid matrix header in the model file");
+	}
+	if (header[0] == 0 || header[1] == 0) return cv::Mat();
+	if (header[2] != CV_32F && header[2] != CV_64F) {
+		CV_Error(CV_StsParseError, "Unsupported matrix type in the model file");
+	}
+
+	// ファイルの残りのサイズと比較する
+	std::streamoff pos = in.tellg();
+	in.seekg(0, ios::end);
+	std::streamoff remaining = in.tellg() - pos;
+	in.seekg(pos);
+	double bytes = (double)header[0] * header[1] * CV_ELEM_SIZE(header[2]);
+	if (bytes > (double)remaining) {
+		CV_Error(CV_StsParseError, "Matrix data is truncated in the model file");
+	}
+
+	cv::Mat m(header[0], header[1], header[2]);
+	in.read((char*)m.data, m.total() * m.elemSize());
+
+	return m;
+}
+
+/**
+ * PCA/whiteningの変換を書き出す。
+ */
+void InverseModel::writeWhitening(ofstream& out, const Whitening& whitening) {
+	writeMat(out, whitening.getMean());
+	writeMat(out, whitening.getProjection());
+}
+
+/**
+ * writeWhitening()で書き出した変換を読み込む (空の場合は、whiteningなし)。
+ */
+Whitening InverseModel::readWhitening(ifstream& in) {
+	cv::Mat_<double> mean = readMat(in);
+	cv::Mat_<double> projection = readMat(in);
+	if (projection.empty()) return Whitening();
+
+	return Whitening(mean, projection);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include <fstream>
+#include <string>
+#include "Dataset.h"
+#include "Whitening.h"
+
+using namespace std;
+
+/**
+ * Base class of the models that estimate PM parameters from high-level indicators.
+ * It holds the normalization parameters and implements the binary save/load shared by all models.
+ */
+class InverseModel {
+	friend class BaggingRegression;
+
+protected:
+	cv::Mat_<double> muX;
+	cv::Mat_<double> maxX;
+	cv::Mat_<double> muY;
+	cv::Mat_<double> maxY;
+	double whiteningEnergy;
+	Whitening whitening;
+
+public:
+	InverseModel() : whiteningEnergy(0.0) {}
+	virtual ~InverseModel() {}
+
+	virtual void fit(const Dataset& dataset) = 0;
+	virtual cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y) const = 0;
+	cv::Mat_<double> predict(const cv::Mat_<double>& y) const;
+	const cv::Mat_<double>& getMaxX() const;
+	void setWhitening(double energy);
+	const Whitening& getWhitening() const;
+	bool save(const string& fileName) const;
+	bool load(const string& fileName);
+
+	static cv::Ptr<InverseModel> open(const string& fileName);
+	static cv::Ptr<InverseModel> create(const string& tag);
+
+protected:
+	virtual string tag() const = 0;
+	virtual void write(ofstream& out) const = 0;
+	virtual void read(ifstream& in) = 0;
+	virtual void write(ofstream& out, bool whitened) const { write(out); }
+	virtual void read(ifstream& in, bool whitened) { read(in); }
+	virtual bool hasWhitening() const;
+
+	void normalize(const Dataset& dataset, cv::Mat_<double>& X2, cv::Mat_<double>& Y2);
+	cv::Mat_<double> normalizeY(const cv::Mat_<double>& Y) const;
+	cv::Mat_<double> denormalizeX(const cv::Mat_<double>& X2) const;
+
+	static void writeMat(ofstream& out, const cv::Mat& m);
+	static cv::Mat readMat(ifstream& in);
+	static void writeWhitening(ofstream& out, const Whitening& whitening);
+	static Whitening readWhitening(ifstream& in);
+};
+
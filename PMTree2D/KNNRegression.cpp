@@ -0,0 +1,114 @@
+﻿#include "KNNRegression.h"
+
+/**
+ * k近傍法によるinverseマッピング。
+ * 学習データのhigh-level indicatorをKD-treeで索引付けし、
+ * クエリに近いk個のサンプルのPMパラメータを、距離で重み付けして平均する。
+ *
+ * @param k				近傍の数
+ * @param numTrees		randomized KD-treeの数
+ * @param checks		探索で調べる葉の最大数 (FLANN_CHECKS_UNLIMITEDなら厳密な探索)
+ */
+KNNRegression::KNNRegression(int k, int numTrees, int checks) {
+	this->k = k;
+	this->numTrees = numTrees;
+	this->checks = checks;
+}
+
+/**
+ * 正規化したhigh-level indicatorでKD-treeを構築する。学習はO(N log N)で済む。
+ *
+ * @param dataset		学習データ
+ */
+void KNNRegression::fit(const Dataset& dataset) {
+	cv::Mat_<double> Y2;
+	normalize(dataset, X2, Y2);
+	features = toFeatures(Y2);
+
+	buildIndex();
+}
+
+/**
+ * 複数のhigh-level indicatorから、PMパラメータをまとめて推定する。
+ * 近傍のPMパラメータを、二乗距離の逆数で重み付けして平均する。
+ *
+ * @param Y		high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @return		PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> KNNRegression::predictBatch(const cv::Mat_<double>& Y) const {
+	int K = min(k, features.rows);
+	int M = X2.cols;
+
+	cv::Mat_<float> queries = toFeatures(normalizeY(Y));
+	cv::Mat_<int> indices(queries.rows, K);
+	cv::Mat_<float> dists(queries.rows, K);
+	index->knnSearch(queries, indices, dists, K, cv::flann::SearchParams(checks));
+
+	cv::Mat_<double> X2_hat = cv::Mat_<double>::zeros(queries.rows, M);
+	for (int r = 0; r < queries.rows; ++r) {
+		const int* idx = indices[r];
+		const float* d = dists[r];
+		double* x = X2_hat[r];
+
+		double total = 0.0;
+		for (int i = 0; i < K; ++i) {
+			double w = 1.0 / (d[i] + 1.0e-12);
+			const double* xi = X2[idx[i]];
+			for (int c = 0; c < M; ++c) {
+				x[c] += w * xi[c];
+			}
+			total += w;
+		}
+		for (int c = 0; c < M; ++c) {
+			x[c] /= total;
+		}
+	}
+
+	return denormalizeX(X2_hat);
+}
+
+string KNNRegression::tag() const {
+	return "KNN ";
+}
+
+/**
+ * 近傍の数と学習データを書き出す。
+ * KD-treeは、読み込み時に構築し直す。
+ */
+void KNNRegression::write(ofstream& out) const {
+	out.write((const char*)&k, sizeof(int));
+	out.write((const char*)&numTrees, sizeof(int));
+	out.write((const char*)&checks, sizeof(int));
+	writeMat(out, features);
+	writeMat(out, X2);
+}
+
+/**
+ * write()で書き出したモデルを読み込み、KD-treeを構築する。
+ */
+void KNNRegression::read(ifstream& in) {
+	in.read((char*)&k, sizeof(int));
+	in.read((char*)&numTrees, sizeof(int));
+	in.read((char*)&checks, sizeof(int));
+	features = readMat(in);
+	X2 = readMat(in);
+
+	buildIndex();
+}
+
+/**
+ * 正規化したhigh-level indicatorから定数項の列を除き、FLANN用にfloatに変換する。
+ */
+cv::Mat_<float> KNNRegression::toFeatures(const cv::Mat_<double>& Y2) const {
+	cv::Mat_<float> F;
+	Y2.colRange(0, Y2.cols - 1).convertTo(F, CV_32F);
+
+	return F;
+}
+
+/**
+ * randomized KD-forestを構築する。
+ */
+void KNNRegression::buildIndex() {
+	index = new cv::flann::Index(features, cv::flann::KDTreeIndexParams(numTrees));
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "InverseModel.h"
+
+class KNNRegression : public InverseModel {
+private:
+	int k;
+	int numTrees;
+	int checks;
+	cv::Mat_<float> features;
+	cv::Mat_<double> X2;
+	mutable cv::Ptr<cv::flann::Index> index; // knnSearch() is not const
+
+public:
+	KNNRegression(int k = 5, int numTrees = 4, int checks = cvflann::FLANN_CHECKS_UNLIMITED);
+
+	void fit(const Dataset& dataset);
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y) const;
+
+protected:
+	string tag() const;
+	void write(ofstream& out) const;
+	void read(ifstream& in);
+
+private:
+	cv::Mat_<float> toFeatures(const cv::Mat_<double>& Y2) const;
+	void buildIndex();
+};
+
@@ -0,0 +1,148 @@
+﻿#include "LevenbergMarquardtSolver.h"
+#include "ForwardSimulator.h"
+#include <iostream>
+
+using namespace std;
+
+/**
+ * Levenberg-Marquardt法により、指定されたhigh-level indicatorを持つ木のPMパラメータを、
+ * 初期値から局所的に改善する。ヤコビ行列は、ForwardSimulator::jacobian()で差分により計算する。
+ *
+ * @param scale		high-level indicatorの各列のスケール (残差を、これで割る)
+ */
+LevenbergMarquardtSolver::LevenbergMarquardtSolver(const cv::Mat_<double>& scale) {
+	this->scale = scale.clone();
+	this->scale.setTo(1.0, this->scale == 0);
+
+	vector<float> l, u;
+	PMTree2D::getParamRange(l, u);
+	lower = cv::Mat_<double>(1, l.size());
+	upper = cv::Mat_<double>(1, u.size());
+	for (int i = 0; i < l.size(); ++i) {
+		lower(0, i) = l[i];
+		upper(0, i) = u[i];
+	}
+
+	maxIterations = 10;
+	tolerance = 0.01;
+	relStep = 0.01;
+	initialError = 0.0;
+	error = 0.0;
+	iterations = 0;
+}
+
+void LevenbergMarquardtSolver::setMaxIterations(int maxIterations) {
+	this->maxIterations = maxIterations;
+}
+
+/**
+ * エラー (high-level indicatorの正規化されたRMSE) がこの値を下回ったら、反復を打ち切る。
+ */
+void LevenbergMarquardtSolver::setTolerance(double tolerance) {
+	this->tolerance = tolerance;
+}
+
+/**
+ * ヤコビ行列を計算する差分の刻み幅 (パラメータの範囲に対する比率) をセットする。
+ */
+void LevenbergMarquardtSolver::setStep(double relStep) {
+	this->relStep = relStep;
+}
+
+/**
+ * 初期値x0から、Levenberg-Marquardt法でPMパラメータを改善する。
+ * ステップが改善しなければ減衰係数を大きくして (勾配法に近づけて) やり直し、
+ * 改善すれば小さくして (Gauss-Newton法に近づけて) 次に進む。
+ * 試行点の評価は木の生成1回で済ませ、ヤコビ行列 (2n+1回の生成) は採用した点でだけ計算する。
+ *
+ * @param target	high-level indicator (行ベクトル)
+ * @param x0		初期値 (行ベクトル。回帰の推定値など)
+ * @return			改善したPMパラメータ (行ベクトル)
+ */
+cv::Mat_<double> LevenbergMarquardtSolver::solve(const cv::Mat_<double>& target, const cv::Mat_<double>& x0) {
+	cv::Mat_<double> x;
+	cv::max(cv::min(x0, upper), lower, x);
+
+	cv::Mat_<double> stats, r;
+	bool valid = ForwardSimulator::simulate(x, stats);
+	error = valid ? cost(stats, target, r) : numeric_limits<double>::max();
+	initialError = error;
+
+	double lambda = 1.0e-2;
+	for (iterations = 0; iterations < maxIterations && valid && error > tolerance; ++iterations) {
+		// 採用した点で、正規化した残差のヤコビ行列を計算する
+		cv::Mat_<double> J, stats_J;
+		if (!ForwardSimulator::jacobian(x, relStep, J, stats_J)) break;
+		cv::Mat_<double> Jr = J / cv::repeat(scale.t(), 1, J.cols);
+		cv::Mat_<double> JtJ, Jtr;
+		cv::mulTransposed(Jr, JtJ, true);
+		cv::gemm(Jr, r, 1.0, cv::noArray(), 0.0, Jtr, cv::GEMM_1_T);
+
+		bool improved = false;
+		while (lambda < 1.0e8) {
+			// (J^T J + lambda diag(J^T J)) delta = -J^T r
+			cv::Mat_<double> A = JtJ.clone();
+			for (int i = 0; i < A.rows; ++i) {
+				A(i, i) += lambda * max(JtJ(i, i), 1.0e-12);
+			}
+			cv::Mat_<double> delta;
+			cv::solve(A, -Jtr, delta, cv::DECOMP_CHOLESKY);
+
+			cv::Mat_<double> x_new;
+			cv::max(cv::min(x + delta.t(), upper), lower, x_new);
+
+			// 試行点は、1回の生成だけで評価する
+			cv::Mat_<double> stats_new, r_new;
+			if (ForwardSimulator::simulate(x_new, stats_new)) {
+				double error_new = cost(stats_new, target, r_new);
+				if (error_new < error) {
+					x = x_new;
+					r = r_new;
+					error = error_new;
+					lambda = max(lambda * 0.1, 1.0e-8);
+					improved = true;
+					break;
+				}
+			}
+			lambda *= 10.0;
+		}
+		if (!improved) break;
+	}
+
+	return x;
+}
+
+/**
+ * 最後のsolve()での、初期値のエラーを返却する。
+ */
+double LevenbergMarquardtSolver::getInitialError() const {
+	return initialError;
+}
+
+/**
+ * 最後のsolve()で得られた解のエラーを返却する。
+ */
+double LevenbergMarquardtSolver::getError() const {
+	return error;
+}
+
+/**
+ * 最後のsolve()でかかった反復回数を返却する。
+ */
+int LevenbergMarquardtSolver::getIterations() const {
+	return iterations;
+}
+
+/**
+ * 正規化した残差と、その正規化されたRMSEを計算する。
+ *
+ * @param stats		統計情報 (行ベクトル)
+ * @param target	high-level indicator (行ベクトル)
+ * @param r [OUT]	正規化した残差 (列ベクトル)
+ * @return			正規化されたRMSE
+ */
+double LevenbergMarquardtSolver::cost(const cv::Mat_<double>& stats, const cv::Mat_<double>& target, cv::Mat_<double>& r) const {
+	r = cv::Mat_<double>((stats - target) / scale).t();
+
+	return sqrt(r.dot(r) / r.rows);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+
+class LevenbergMarquardtSolver {
+private:
+	cv::Mat_<double> scale;
+	cv::Mat_<double> lower;
+	cv::Mat_<double> upper;
+	int maxIterations;
+	double tolerance;
+	double relStep;
+	double initialError;
+	double error;
+	int iterations;
+
+public:
+	LevenbergMarquardtSolver(const cv::Mat_<double>& scale);
+
+	void setMaxIterations(int maxIterations);
+	void setTolerance(double tolerance);
+	void setStep(double relStep);
+	cv::Mat_<double> solve(const cv::Mat_<double>& target, const cv::Mat_<double>& x0);
+	double getInitialError() const;
+	double getError() const;
+	int getIterations() const;
+
+private:
+	double cost(const cv::Mat_<double>& stats, const cv::Mat_<double>& target, cv::Mat_<double>& r) const;
+};
+
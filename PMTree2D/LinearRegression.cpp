@@ -0,0 +1,46 @@
+﻿#include "LinearRegression.h"
+
+/**
+ * Linear regressionにより、マッピング行列Wを求める（yW = x より、W = y^+ x)。
+ * lambdaが正の場合は、リッジ回帰 W = (y^T y + lambda I)^-1 y^T x とする (定数項は正則化しない)。
+ *
+ * @param dataset		学習データ
+ */
+void LinearRegression::fit(const Dataset& dataset) {
+	cv::Mat_<double> X2, Y2;
+	normalize(dataset, X2, Y2);
+
+	if (lambda <= 0.0) {
+		W = Y2.inv(cv::DECOMP_SVD) * X2;
+		return;
+	}
+
+	cv::Mat_<double> A;
+	cv::mulTransposed(Y2, A, true);
+	for (int i = 0; i < A.rows - 1; ++i) {
+		A(i, i) += lambda;
+	}
+	cv::solve(A, Y2.t() * X2, W, cv::DECOMP_SVD);
+}
+
+/**
+ * 複数のhigh-level indicatorから、PMパラメータをまとめて推定する。
+ *
+ * @param Y		high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @return		PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> LinearRegression::predictBatch(const cv::Mat_<double>& Y) const {
+	return denormalizeX(normalizeY(Y) * W);
+}
+
+string LinearRegression::tag() const {
+	return "LR  ";
+}
+
+void LinearRegression::write(ofstream& out) const {
+	writeMat(out, W);
+}
+
+void LinearRegression::read(ifstream& in) {
+	W = readMat(in);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "InverseModel.h"
+
+class LinearRegression : public InverseModel {
+private:
+	double lambda;
+	cv::Mat_<double> W;
+
+public:
+	LinearRegression(double lambda = 0.0) : lambda(lambda) {}
+
+	void fit(const Dataset& dataset);
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y) const;
+
+protected:
+	string tag() const;
+	void write(ofstream& out) const;
+	void read(ifstream& in);
+};
+
@@ -0,0 +1,259 @@
+﻿#include "MLPRegression.h"
+#include <random>
+#include <algorithm>
+#include <iostream>
+
+/**
+ * ミニバッチをスレッド数のシャードに分け、各シャードの勾配を並列に計算する。
+ * 各シャードは自分のバッファに書き込むので、ロックは不要。
+ */
+class MLPGradient : public cv::ParallelLoopBody {
+private:
+	const MLPRegression* mlp;
+	const cv::Mat_<float>& X;
+	const cv::Mat_<float>& T;
+	const vector<int>& indices;
+	int start;
+	int end;
+	int numShards;
+	vector<vector<cv::Mat_<float> > >& gradW;
+	vector<vector<cv::Mat_<float> > >& gradB;
+	vector<double>& loss;
+
+public:
+	MLPGradient(const MLPRegression* mlp, const cv::Mat_<float>& X, const cv::Mat_<float>& T, const vector<int>& indices, int start, int end, int numShards, vector<vector<cv::Mat_<float> > >& gradW, vector<vector<cv::Mat_<float> > >& gradB, vector<double>& loss) : mlp(mlp), X(X), T(T), indices(indices), start(start), end(end), numShards(numShards), gradW(gradW), gradB(gradB), loss(loss) {}
+
+	void operator()(const cv::Range& range) const {
+		int L = mlp->W.size();
+
+		for (int s = range.start; s < range.end; ++s) {
+			int s0 = start + (end - start) * s / numShards;
+			int s1 = start + (end - start) * (s + 1) / numShards;
+			if (s0 == s1) {
+				for (int l = 0; l < L; ++l) {
+					gradW[s][l] = cv::Mat_<float>::zeros(mlp->W[l].size());
+					gradB[s][l] = cv::Mat_<float>::zeros(mlp->b[l].size());
+				}
+				loss[s] = 0.0;
+				continue;
+			}
+
+			cv::Mat_<float> Xs(s1 - s0, X.cols);
+			cv::Mat_<float> Ts(s1 - s0, T.cols);
+			for (int i = s0; i < s1; ++i) {
+				X.row(indices[i]).copyTo(Xs.row(i - s0));
+				T.row(indices[i]).copyTo(Ts.row(i - s0));
+			}
+
+			vector<cv::Mat_<float> > A;
+			mlp->forward(Xs, A);
+
+			// 二乗誤差の勾配 (ミニバッチ全体の平均)
+			cv::Mat_<float> dZ = A[L] - Ts;
+			loss[s] = cv::norm(dZ, cv::NORM_L2SQR);
+			dZ *= 2.0f / ((end - start) * T.cols);
+
+			for (int l = L - 1; l >= 0; --l) {
+				cv::gemm(A[l], dZ, 1.0, cv::noArray(), 0.0, gradW[s][l], cv::GEMM_1_T);
+				cv::reduce(dZ, gradB[s][l], 0, CV_REDUCE_SUM);
+				if (l == 0) break;
+
+				// tanhの微分は 1 - a^2
+				cv::Mat_<float> dA;
+				cv::gemm(dZ, mlp->W[l], 1.0, cv::noArray(), 0.0, dA, cv::GEMM_2_T);
+				dZ = dA.mul(1.0f - A[l].mul(A[l]));
+			}
+		}
+	}
+};
+
+/**
+ * 多層パーセプトロンによるinverseマッピング。
+ * 正規化したhigh-level indicatorを入力とし、隠れ層 (tanh) を経て、正規化したPMパラメータを出力する。
+ * ミニバッチのAdamで学習し、各ミニバッチの勾配は、シャードごとに並列に行列積 (cv::gemm) で計算して足し合わせる。
+ * 推定は、層ごとの1回の行列積で済む。
+ *
+ * @param hiddenSize		隠れ層のユニット数
+ * @param numHidden			隠れ層の数
+ * @param epochs			エポック数
+ * @param batchSize			ミニバッチのサイズ
+ * @param learningRate		学習率
+ */
+MLPRegression::MLPRegression(int hiddenSize, int numHidden, int epochs, int batchSize, double learningRate) {
+	this->hiddenSize = hiddenSize;
+	this->numHidden = numHidden;
+	this->epochs = epochs;
+	this->batchSize = batchSize;
+	this->learningRate = learningRate;
+}
+
+/**
+ * 正規化したhigh-level indicatorからPMパラメータへのネットワークを、Adamで学習する。
+ * 重みはXavierの一様分布で初期化し、エポックごとにサンプルをシャッフルする。
+ *
+ * @param dataset		学習データ
+ */
+void MLPRegression::fit(const Dataset& dataset) {
+	cv::Mat_<double> X2, Y2;
+	normalize(dataset, X2, Y2);
+
+	cv::Mat_<float> input, target;
+	Y2.convertTo(input, CV_32F);
+	X2.convertTo(target, CV_32F);
+	int N = input.rows;
+
+	// 重みの初期化
+	std::mt19937 mt(0);
+	int L = numHidden + 1;
+	W.resize(L);
+	b.resize(L);
+	for (int l = 0; l < L; ++l) {
+		int rows = l == 0 ? input.cols : hiddenSize;
+		int cols = l == L - 1 ? target.cols : hiddenSize;
+		float limit = sqrt(6.0f / (rows + cols));
+		std::uniform_real_distribution<float> u(-limit, limit);
+		W[l] = cv::Mat_<float>(rows, cols);
+		for (int r = 0; r < rows; ++r) {
+			for (int c = 0; c < cols; ++c) {
+				W[l](r, c) = u(mt);
+			}
+		}
+		b[l] = cv::Mat_<float>::zeros(1, cols);
+	}
+
+	// Adamのモーメント
+	const double beta1 = 0.9;
+	const double beta2 = 0.999;
+	const double eps = 1.0e-8;
+	vector<cv::Mat_<float> > mW(L), vW(L), mb(L), vb(L);
+	for (int l = 0; l < L; ++l) {
+		mW[l] = cv::Mat_<float>::zeros(W[l].size());
+		vW[l] = cv::Mat_<float>::zeros(W[l].size());
+		mb[l] = cv::Mat_<float>::zeros(b[l].size());
+		vb[l] = cv::Mat_<float>::zeros(b[l].size());
+	}
+
+	int numShards = max(cv::getNumThreads(), 1);
+	vector<vector<cv::Mat_<float> > > gradW(numShards, vector<cv::Mat_<float> >(L));
+	vector<vector<cv::Mat_<float> > > gradB(numShards, vector<cv::Mat_<float> >(L));
+	vector<double> loss(numShards);
+
+	vector<int> indices(N);
+	for (int i = 0; i < N; ++i) indices[i] = i;
+
+	int t = 0;
+	for (int epoch = 0; epoch < epochs; ++epoch) {
+		for (int i = N - 1; i > 0; --i) {
+			std::uniform_int_distribution<int> u(0, i);
+			swap(indices[i], indices[u(mt)]);
+		}
+
+		double total = 0.0;
+		for (int start = 0; start < N; start += batchSize) {
+			int end = min(start + batchSize, N);
+			cv::parallel_for_(cv::Range(0, numShards), MLPGradient(this, input, target, indices, start, end, numShards, gradW, gradB, loss));
+
+			++t;
+			double lr = learningRate * sqrt(1.0 - pow(beta2, t)) / (1.0 - pow(beta1, t));
+			for (int l = 0; l < L; ++l) {
+				cv::Mat_<float> gW = gradW[0][l].clone();
+				cv::Mat_<float> gb = gradB[0][l].clone();
+				for (int s = 1; s < numShards; ++s) {
+					gW += gradW[s][l];
+					gb += gradB[s][l];
+				}
+
+				mW[l] = beta1 * mW[l] + (1.0 - beta1) * gW;
+				vW[l] = beta2 * vW[l] + (1.0 - beta2) * gW.mul(gW);
+				mb[l] = beta1 * mb[l] + (1.0 - beta1) * gb;
+				vb[l] = beta2 * vb[l] + (1.0 - beta2) * gb.mul(gb);
+
+				cv::Mat_<float> sW, sb;
+				cv::sqrt(vW[l], sW);
+				cv::sqrt(vb[l], sb);
+				W[l] -= lr * mW[l] / (sW + eps);
+				b[l] -= lr * mb[l] / (sb + eps);
+			}
+			for (int s = 0; s < numShards; ++s) {
+				total += loss[s];
+			}
+		}
+
+		if (epoch % 10 == 0 || epoch == epochs - 1) {
+			std::cout << "Epoch " << epoch << ": loss " << total / ((double)N * target.cols) << std::endl;
+		}
+	}
+}
+
+/**
+ * 複数のhigh-level indicatorから、PMパラメータをまとめて推定する。
+ *
+ * @param Y		high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @return		PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> MLPRegression::predictBatch(const cv::Mat_<double>& Y) const {
+	cv::Mat_<float> input;
+	normalizeY(Y).convertTo(input, CV_32F);
+
+	vector<cv::Mat_<float> > A;
+	forward(input, A);
+
+	cv::Mat_<double> X2_hat;
+	A.back().convertTo(X2_hat, CV_64F);
+
+	return denormalizeX(X2_hat);
+}
+
+string MLPRegression::tag() const {
+	return "MLP ";
+}
+
+/**
+ * ネットワークの構成と、各層の重みを書き出す。
+ */
+void MLPRegression::write(ofstream& out) const {
+	out.write((const char*)&hiddenSize, sizeof(int));
+	out.write((const char*)&numHidden, sizeof(int));
+	for (int l = 0; l < W.size(); ++l) {
+		writeMat(out, W[l]);
+		writeMat(out, b[l]);
+	}
+}
+
+/**
+ * write()で書き出したモデルを読み込む。
+ */
+void MLPRegression::read(ifstream& in) {
+	in.read((char*)&hiddenSize, sizeof(int));
+	in.read((char*)&numHidden, sizeof(int));
+	W.resize(numHidden + 1);
+	b.resize(numHidden + 1);
+	for (int l = 0; l < W.size(); ++l) {
+		W[l] = readMat(in);
+		b[l] = readMat(in);
+	}
+}
+
+/**
+ * 入力から各層の出力を計算する。最後の層以外は、活性化関数にtanhを使う。
+ *
+ * @param X			入力 (各行が、各サンプルを表す)
+ * @param A [OUT]	各層の出力 (A[0]は入力、A[L]は最終出力)
+ */
+void MLPRegression::forward(const cv::Mat_<float>& X, vector<cv::Mat_<float> >& A) const {
+	int L = W.size();
+
+	A.resize(L + 1);
+	A[0] = X;
+	for (int l = 0; l < L; ++l) {
+		cv::gemm(A[l], W[l], 1.0, cv::repeat(b[l], X.rows, 1), 1.0, A[l + 1]);
+		if (l == L - 1) break;
+
+		for (int r = 0; r < A[l + 1].rows; ++r) {
+			float* a = A[l + 1][r];
+			for (int c = 0; c < A[l + 1].cols; ++c) {
+				a[c] = tanh(a[c]);
+			}
+		}
+	}
+}
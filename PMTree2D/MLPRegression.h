@@ -0,0 +1,31 @@
+#pragma once
+
+#include "InverseModel.h"
+
+class MLPRegression : public InverseModel {
+	friend class MLPGradient;
+
+private:
+	int hiddenSize;
+	int numHidden;
+	int epochs;
+	int batchSize;
+	double learningRate;
+	vector<cv::Mat_<float> > W;
+	vector<cv::Mat_<float> > b;
+
+public:
+	MLPRegression(int hiddenSize = 64, int numHidden = 2, int epochs = 100, int batchSize = 256, double learningRate = 1.0e-3);
+
+	void fit(const Dataset& dataset);
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y) const;
+
+protected:
+	string tag() const;
+	void write(ofstream& out) const;
+	void read(ifstream& in);
+
+private:
+	void forward(const cv::Mat_<float>& X, vector<cv::Mat_<float> >& A) const;
+};
+
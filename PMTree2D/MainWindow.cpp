@@ -4,8 +4,23 @@
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
 #include <fstream>
-#include "DataPartition.h"
-#include "GaussianProcess.h"
+#include "Evaluation.h"
+#include "LinearRegression.h"
+#include "HierarchicalLR.h"
+#include "GaussianProcessRegression.h"
+#include "RandomFourierRegression.h"
+#include "KNNRegression.h"
+#include "MLPRegression.h"
+#include "RandomForestRegression.h"
+#include "BaggingRegression.h"
+#include "HNSWIndex.h"
+#include "CMAESSolver.h"
+#include "LevenbergMarquardtSolver.h"
+#include "SurrogateSimulator.h"
+#include "BayesianOptimizer.h"
+#include "ActiveLearner.h"
+#include "CrossValidation.h"
+#include "ForwardSimulator.h"
 
 MainWindow::MainWindow(QWidget *parent, Qt::WFlags flags) : QMainWindow(parent, flags) {
 	ui.setupUi(this);
@@ -20,6 +35,20 @@ MainWindow::MainWindow(QWidget *parent, Qt::WFlags flags) : QMainWindow(parent,
 	connect(ui.actionInversePMByLinearRegression3, SIGNAL(triggered()), this, SLOT(onInversePMByLinearRegression3()));
 	connect(ui.actionInversePMByHierarchicalLR, SIGNAL(triggered()), this, SLOT(onInversePMByHierarchicalLR()));
 	connect(ui.actionInversePMByGaussianProcess, SIGNAL(triggered()), this, SLOT(onInversePMByGaussianProcess()));
+	connect(ui.actionInversePMByRandomFourierFeatures, SIGNAL(triggered()), this, SLOT(onInversePMByRandomFourierFeatures()));
+	connect(ui.actionInversePMByKNN, SIGNAL(triggered()), this, SLOT(onInversePMByKNN()));
+	connect(ui.actionBuildExampleIndex, SIGNAL(triggered()), this, SLOT(onBuildExampleIndex()));
+	connect(ui.actionInversePMByCMAES, SIGNAL(triggered()), this, SLOT(onInversePMByCMAES()));
+	connect(ui.actionInversePMByLevenbergMarquardt, SIGNAL(triggered()), this, SLOT(onInversePMByLevenbergMarquardt()));
+	connect(ui.actionInversePMByCMAESWithSurrogate, SIGNAL(triggered()), this, SLOT(onInversePMByCMAESWithSurrogate()));
+	connect(ui.actionInversePMByBayesianOptimization, SIGNAL(triggered()), this, SLOT(onInversePMByBayesianOptimization()));
+	connect(ui.actionBuildDatasetByActiveLearning, SIGNAL(triggered()), this, SLOT(onBuildDatasetByActiveLearning()));
+	connect(ui.actionInversePMByMLP, SIGNAL(triggered()), this, SLOT(onInversePMByMLP()));
+	connect(ui.actionInversePMByRandomForest, SIGNAL(triggered()), this, SLOT(onInversePMByRandomForest()));
+	connect(ui.actionInversePMByBagging, SIGNAL(triggered()), this, SLOT(onInversePMByBagging()));
+	connect(ui.actionCrossValidation, SIGNAL(triggered()), this, SLOT(onCrossValidation()));
+	connect(ui.actionCompareWhitening, SIGNAL(triggered()), this, SLOT(onCompareWhitening()));
+	connect(ui.actionInversePMByOutOfCoreGaussianProcess, SIGNAL(triggered()), this, SLOT(onInversePMByOutOfCoreGaussianProcess()));
 	
 	glWidget = new GLWidget3D(this);
 	setCentralWidget(glWidget);
@@ -139,21 +168,20 @@ void MainWindow::onGenerateTrainingFiles() {
 }
 
 /**
- * 1000個のサンプルを生成して、対応するhigh-level indicatorを計算し、
- * inverseマッピングをlinear regressionにより求める。
- * high-level indicatorとして、以下を使用する。
- *    height, width, coverage ratio, average curvature
+ * N個のサンプルを生成して、PMパラメータと対応するhigh-level indicatorのデータセットを作成する。
+ *
+ * @param N				サンプル数
+ * @param statistics	high-level indicatorの種類 (1 - getStatistics1(), 2 - getStatistics2(), 3 - getStatistics3())
+ * @param seed [IN/OUT]	最初の乱数のシード。続けて生成する場合に、次のシードを返す (NULLなら0から始める)
+ * @return				データセット
  */
-void MainWindow::onInversePMByLinearRegression() {
-	const int N = 2000;
-
+Dataset MainWindow::generateDataset(int N, int statistics, int* seed) {
 	if (!QDir("samples").exists()) QDir().mkdir("samples");
 
 	cout << "Generating samples..." << endl;
 
-	cv::Mat_<double> dataX(N, 14);
-	cv::Mat_<double> dataY(N, 5);
-	int seed_count = 0;
+	Dataset dataset;
+	int seed_count = seed != NULL ? *seed : 0;
 	for (int iter = 0; iter < N; ++iter) {
 		cout << iter << endl;
 
@@ -162,76 +190,76 @@ void MainWindow::onInversePMByLinearRegression() {
 			if (glWidget->tree->generate()) break;
 		}
 
-		if (iter % 100 == 0) {
-			glWidget->updateGL();
-			QString fileName = "samples/" + QString::number(iter / 100) + ".png";
-			glWidget->grabFrameBuffer().save(fileName);
-		}
-
 		vector<float> params = glWidget->tree->getParams();
-		for (int col = 0; col < dataX.cols; ++col) {
-			dataX(iter, col) = params[col];
-		}
+		vector<float> stats = glWidget->tree->getStatistics(statistics);
 
-		vector<float> statistics = glWidget->tree->getStatistics1();
-		for (int col = 0; col < dataY.cols - 1; ++col) {
-			dataY(iter, col) = statistics[col];
+		if (iter == 0) {
+			dataset.X.create(N, params.size());
+			dataset.Y.create(N, stats.size());
+		}
+		for (int col = 0; col < dataset.X.cols; ++col) {
+			dataset.X(iter, col) = params[col];
+		}
+		for (int col = 0; col < dataset.Y.cols; ++col) {
+			dataset.Y(iter, col) = stats[col];
 		}
-		dataY(iter, dataY.cols - 1) = 1; // 定数項
 	}
 
 	glWidget->update();
 	controlWidget->update();
 
-	// normalization
-	cv::Mat_<double> muX, muY;
-	cv::reduce(dataX, muX, 0, CV_REDUCE_AVG);
-	cv::reduce(dataY, muY, 0, CV_REDUCE_AVG);
-	cv::Mat_<double> dataX2 = dataX - cv::repeat(muX, N, 1);
-	cv::Mat_<double> dataY2 = dataY - cv::repeat(muY, N, 1);
-
-	// [-1, 1]にする
-	cv::Mat_<double> maxX, maxY;
-	cv::reduce(cv::abs(dataX2), maxX, 0, CV_REDUCE_MAX);
-	cv::reduce(cv::abs(dataY2), maxY, 0, CV_REDUCE_MAX);
-	dataX2 /= cv::repeat(maxX, N, 1);
-	dataY2 /= cv::repeat(maxY, N, 1);
-
-	// 定数項
-	for (int r = 0; r < N; ++r) {
-		dataY2(r, dataY2.cols - 1) = 1;
-	}
+	if (seed != NULL) *seed = seed_count;
 
-	// Linear regressionにより、Wを求める（yW = x より、W = y^+ x)
-	cv::Mat_<double> W = dataY2.inv(cv::DECOMP_SVD) * dataX2;
+	return dataset;
+}
 
-	// reverseで木を生成する
-	cv::Mat_<double> error = cv::Mat_<double>::zeros(1, dataX.cols);
-	cv::Mat_<double> error2 = cv::Mat_<double>::zeros(1, dataX.cols);
-	for (int iter = 0; iter < N; ++iter) {
-		cv::Mat normalized_x_hat = dataY2.row(iter) * W;
-		cv::Mat x_hat = normalized_x_hat.mul(maxX) + muX;
+/**
+ * モデルを学習して保存し、学習データに対する推定値のエラーを計算する。
+ * 100サンプルごとに、元の木と、推定したPMパラメータで生成した木の画像を保存する。
+ *
+ * @param model			inverseモデル
+ * @param dataset		学習データ
+ * @param modelFile	モデルを保存するファイル名
+ */
+void MainWindow::evaluateInverseModel(InverseModel& model, const Dataset& dataset, const string& modelFile) {
+	int64 start = cv::getTickCount();
+	model.fit(dataset);
+	cout << "Training time: " << Evaluation::seconds(start) << " sec" << endl;
 
-		error += (dataX2.row(iter) - normalized_x_hat).mul(dataX2.row(iter) - normalized_x_hat);
-		error2 += (dataX.row(iter) - x_hat).mul(dataX.row(iter) - x_hat);
+	model.save(modelFile);
 
-		if (iter % 100 == 0) {
-			glWidget->tree->setParams(x_hat);
-			glWidget->updateGL();
-			QString fileName = "samples/reversed_" + QString::number(iter / 100) + ".png";
-			glWidget->grabFrameBuffer().save(fileName);
-		}
+	// 全サンプルをまとめて推定し、エラーを計算する
+	start = cv::getTickCount();
+	cv::Mat_<double> X_hat = model.predictBatch(dataset.Y);
+	cv::Mat_<double> error, error2;
+	Evaluation::rmse(X_hat, dataset.X, model.getMaxX(), error, error2);
+	double time = Evaluation::seconds(start);
+
+	// reverseで木を生成する
+	for (int iter = 0; iter < dataset.size(); iter += 100) {
+		glWidget->tree->setParams(dataset.X.row(iter));
+		glWidget->updateGL();
+		QString fileName = "samples/" + QString::number(iter / 100) + ".png";
+		glWidget->grabFrameBuffer().save(fileName);
+
+		glWidget->tree->setParams(X_hat.row(iter));
+		glWidget->updateGL();
+		fileName = "samples/reversed_" + QString::number(iter / 100) + ".png";
+		glWidget->grabFrameBuffer().save(fileName);
 	}
 
-	error /= N;
-	error2 /= N;
-	cv::sqrt(error, error);
-	cv::sqrt(error2, error2);
+	Evaluation::print(error, error2, time);
+}
 
-	cout << "Prediction error (normalized):" << endl;
-	cout << error << endl;
-	cout << "Prediction error:" << endl;
-	cout << error2 << endl;
+/**
+ * 1000個のサンプルを生成して、対応するhigh-level indicatorを計算し、
+ * inverseマッピングをlinear regressionにより求める。
+ * high-level indicatorとして、以下を使用する。
+ *    height, width, coverage ratio, average curvature
+ */
+void MainWindow::onInversePMByLinearRegression() {
+	LinearRegression lr;
+	evaluateInverseModel(lr, generateDataset(2000, 1), "samples/linear_regression1.dat");
 }
 
 /**
@@ -241,92 +269,8 @@ void MainWindow::onInversePMByLinearRegression() {
  *    height, width, 密度のhistogram、average curvature
  */
 void MainWindow::onInversePMByLinearRegression2() {
-	const int N = 2000;
-
-	if (!QDir("samples").exists()) QDir().mkdir("samples");
-
-	cout << "Generating samples..." << endl;
-
-	cv::Mat_<double> dataX(N, 14);
-	cv::Mat_<double> dataY(N, 12);
-	int seed_count = 0;
-	for (int iter = 0; iter < N; ++iter) {
-		cout << iter << endl;
-
-		while (true) {
-			glWidget->tree->randomInit(seed_count++);
-			if (glWidget->tree->generate()) break;
-		}
-
-		if (iter % 100 == 0) {
-			glWidget->updateGL();
-			QString fileName = "samples/" + QString::number(iter / 100) + ".png";
-			glWidget->grabFrameBuffer().save(fileName);
-		}
-
-		vector<float> params = glWidget->tree->getParams();
-		for (int col = 0; col < dataX.cols; ++col) {
-			dataX(iter, col) = params[col];
-		}
-
-		vector<float> statistics = glWidget->tree->getStatistics2();
-		for (int col = 0; col < dataY.cols - 1; ++col) {
-			dataY(iter, col) = statistics[col];
-		}
-		dataY(iter, dataY.cols - 1) = 1; // 定数項
-	}
-
-	glWidget->update();
-	controlWidget->update();
-
-	// normalization
-	cv::Mat_<double> muX, muY;
-	cv::reduce(dataX, muX, 0, CV_REDUCE_AVG);
-	cv::reduce(dataY, muY, 0, CV_REDUCE_AVG);
-	cv::Mat_<double> dataX2 = dataX - cv::repeat(muX, N, 1);
-	cv::Mat_<double> dataY2 = dataY - cv::repeat(muY, N, 1);
-
-	// [-1, 1]にする
-	cv::Mat_<double> maxX, maxY;
-	cv::reduce(cv::abs(dataX2), maxX, 0, CV_REDUCE_MAX);
-	cv::reduce(cv::abs(dataY2), maxY, 0, CV_REDUCE_MAX);
-	dataX2 /= cv::repeat(maxX, N, 1);
-	dataY2 /= cv::repeat(maxY, N, 1);
-
-	// 定数項
-	for (int r = 0; r < N; ++r) {
-		dataY2(r, dataY2.cols - 1) = 1;
-	}
-
-	// Linear regressionにより、Wを求める（yW = x より、W = y^+ x)
-	cv::Mat_<double> W = dataY2.inv(cv::DECOMP_SVD) * dataX2;
-	
-	// reverseで木を生成する
-	cv::Mat_<double> error = cv::Mat_<double>::zeros(1, dataX.cols);
-	cv::Mat_<double> error2 = cv::Mat_<double>::zeros(1, dataX.cols);
-	for (int iter = 0; iter < N; ++iter) {
-		cv::Mat normalized_x_hat = dataY2.row(iter) * W;
-		cv::Mat x_hat = normalized_x_hat.mul(maxX) + muX;
-
-		error += (dataX2.row(iter) - normalized_x_hat).mul(dataX2.row(iter) - normalized_x_hat);
-		error2 += (dataX.row(iter) - x_hat).mul(dataX.row(iter) - x_hat);
-
-		if (iter % 100 == 0) {
-			glWidget->tree->setParams(x_hat);
-			glWidget->updateGL();
-			QString fileName = "samples/reversed_" + QString::number(iter / 100) + ".png";
-			glWidget->grabFrameBuffer().save(fileName);
-		}
-	}
-	error /= N;
-	error2 /= N;
-	cv::sqrt(error, error);
-	cv::sqrt(error2, error2);
-
-	cout << "Prediction error (normalized):" << endl;
-	cout << error << endl;
-	cout << "Prediction error:" << endl;
-	cout << error2 << endl;
+	LinearRegression lr;
+	evaluateInverseModel(lr, generateDataset(2000, 2), "samples/linear_regression2.dat");
 }
 
 /**
@@ -336,310 +280,673 @@ void MainWindow::onInversePMByLinearRegression2() {
  *    height, width, 密度のhistogram、curvatureのhistogram
  */
 void MainWindow::onInversePMByLinearRegression3() {
-	const int N = 2000;
-
-	if (!QDir("samples").exists()) QDir().mkdir("samples");
-
-	cout << "Generating samples..." << endl;
+	LinearRegression lr;
+	evaluateInverseModel(lr, generateDataset(2000, 3), "samples/linear_regression3.dat");
+}
 
-	cv::Mat_<double> dataX(N, 14);
-	cv::Mat_<double> dataY(N, 16);
-	int seed_count = 0;
-	for (int iter = 0; iter < N; ++iter) {
-		cout << iter << endl;
+/**
+ * データを階層的にクラスタリングし、各クラスタについてLinear regression
+ * を使って、high-level indicatorから対応するPMパラメータを計算する。
+ *
+ * 1) 2000個のサンプルを生成して、high-level indicatorを計算する。
+ * 2) データを、k-meansにより階層的にクラスタリングする。
+ * 3) 各クラスタについて、Linear regressionによりマッピング行列Wを計算する。
+ * 4) マッピング行列Wを使って、high-level indicatorからPMパラメータを推定する。
+ * 5) 推定値のエラーを計算する。
+ */
+void MainWindow::onInversePMByHierarchicalLR() {
+	Dataset dataset = generateDataset(2000, 3);
 
-		while (true) {
-			glWidget->tree->randomInit(seed_count++);
-			if (glWidget->tree->generate()) break;
-		}
+	HierarchicalLR hlr(20);
+	evaluateInverseModel(hlr, dataset, "samples/hierarchical_lr.dat");
 
-		if (iter % 100 == 0) {
-			glWidget->updateGL();
-			QString fileName = "samples/" + QString::number(iter / 100) + ".png";
-			glWidget->grabFrameBuffer().save(fileName);
-		}
+	// 近い3つのクラスタを混合して推定した場合のエラー
+	int64 start = cv::getTickCount();
+	cv::Mat_<double> X_soft = hlr.predictBatch(dataset.Y, 3);
+	cv::Mat_<double> error, error2;
+	Evaluation::rmse(X_soft, dataset.X, hlr.getMaxX(), error, error2);
+	double time = Evaluation::seconds(start);
 
-		vector<float> params = glWidget->tree->getParams();
-		for (int col = 0; col < dataX.cols; ++col) {
-			dataX(iter, col) = params[col];
-		}
+	cout << "Top-3 mixture:" << endl;
+	Evaluation::print(error, error2, time);
+}
 
-		vector<float> statistics = glWidget->tree->getStatistics3();
-		for (int col = 0; col < dataY.cols - 1; ++col) {
-			dataY(iter, col) = statistics[col];
+/**
+ * ガウス過程を使って、high-level indicatorから対応するPMパラメータを推定する。
+ *
+ * 1) 2000個のサンプルを生成して、high-level indicatorを計算する。
+ * 2) 対数周辺尤度を最大化するように、ガウス過程のhyperparameterを最適化する。
+ * 3) ガウス過程を使って、high-level indictorから、PMパラメータを推定する。
+ * 4) 推定値のエラーを計算する。
+ * 5) 新しく200個のサンプルを予測分散でソートし、分散が小さい半分と大きい半分のエラーを比較する。
+ */
+void MainWindow::onInversePMByGaussianProcess() {
+	int seed = 0;
+	GaussianProcessRegression gpr(8, 50, 500);
+	evaluateInverseModel(gpr, generateDataset(2000, 3, &seed), "samples/gaussian_process.dat");
+
+	Dataset tests = generateDataset(200, 3, &seed);
+	int64 start = cv::getTickCount();
+	cv::Mat_<double> variance;
+	cv::Mat_<double> X_hat = gpr.predictBatch(tests.Y, variance);
+	cout << "Prediction time with variance: " << Evaluation::seconds(start) << " sec" << endl;
+
+	cv::Mat_<int> order;
+	cv::sortIdx(variance, order, CV_SORT_EVERY_COLUMN + CV_SORT_ASCENDING);
+	int half = tests.size() / 2;
+	for (int k = 0; k < 2; ++k) {
+		cv::Mat_<double> X_k(half, X_hat.cols), X_hat_k(half, X_hat.cols);
+		double meanVariance = 0.0;
+		for (int i = 0; i < half; ++i) {
+			int r = order(k * half + i, 0);
+			tests.X.row(r).copyTo(X_k.row(i));
+			X_hat.row(r).copyTo(X_hat_k.row(i));
+			meanVariance += variance(r, 0) / half;
 		}
-		dataY(iter, dataY.cols - 1) = 1; // 定数項
-	}
-
-	glWidget->update();
-	controlWidget->update();
 
-	// normalization
-	cv::Mat_<double> muX, muY;
-	cv::reduce(dataX, muX, 0, CV_REDUCE_AVG);
-	cv::reduce(dataY, muY, 0, CV_REDUCE_AVG);
-	cv::Mat_<double> dataX2 = dataX - cv::repeat(muX, N, 1);
-	cv::Mat_<double> dataY2 = dataY - cv::repeat(muY, N, 1);
-
-	// [-1, 1]にする
-	cv::Mat_<double> maxX, maxY;
-	cv::reduce(cv::abs(dataX2), maxX, 0, CV_REDUCE_MAX);
-	cv::reduce(cv::abs(dataY2), maxY, 0, CV_REDUCE_MAX);
-	dataX2 /= cv::repeat(maxX, N, 1);
-	dataY2 /= cv::repeat(maxY, N, 1);
-
-	// 定数項
-	for (int r = 0; r < N; ++r) {
-		dataY2(r, dataY2.cols - 1) = 1;
+		cv::Mat_<double> error, error2;
+		Evaluation::rmse(X_hat_k, X_k, gpr.getMaxX(), error, error2);
+		cout << (k == 0 ? "Low" : "High") << " variance half (mean std " << sqrt(meanVariance) << "): normalized error " << cv::mean(error)[0] << endl;
 	}
-
-	// Linear regressionにより、Wを求める（yW = x より、W = y^+ x)
-	cv::Mat_<double> W = dataY2.inv(cv::DECOMP_SVD) * dataX2;
-
-	// reverseで木を生成する
-	cv::Mat_<double> error = cv::Mat_<double>::zeros(1, dataX.cols);
-	cv::Mat_<double> error2 = cv::Mat_<double>::zeros(1, dataX.cols);
-	for (int iter = 0; iter < N; ++iter) {
-		cv::Mat normalized_x_hat = dataY2.row(iter) * W;
-		cv::Mat x_hat = normalized_x_hat.mul(maxX) + muX;
-		error += (dataX2.row(iter) - normalized_x_hat).mul(dataX2.row(iter) - normalized_x_hat);
-		error2 += (dataX.row(iter) - x_hat).mul(dataX.row(iter) - x_hat);
-
-		if (iter % 100 == 0) {
-			glWidget->tree->setParams(x_hat);
-			glWidget->updateGL();
-			QString fileName = "samples/reversed_" + QString::number(iter / 100) + ".png";
-			glWidget->grabFrameBuffer().save(fileName);
-		}
-	}
-
-	error /= N;
-	error2 /= N;
-	cv::sqrt(error, error);
-	cv::sqrt(error2, error2);
-
-	cout << "Prediction error (normalized):" << endl;
-	cout << error << endl;
-	cout << "Prediction error:" << endl;
-	cout << error2 << endl;
 }
 
 /**
- * データを階層的にクラスタリングし、各クラスタについてLinear regression
- * を使って、high-level indicatorから対応するPMパラメータを計算する。
+ * ランダムフーリエ特徴でガウス過程を近似した回帰を使って、high-level indicatorから対応するPMパラメータを推定する。
  *
  * 1) 2000個のサンプルを生成して、high-level indicatorを計算する。
- * 2) データを、k-meansにより階層的にクラスタリングする。
- * 3) 各クラスタについて、Linear regressionによりマッピング行列Wを計算する。
- * 4) マッピング行列Wを使って、high-level indicatorからPMパラメータを推定する。
+ * 2) 一部のサンプルで、ガウス過程のhyperparameterを最適化する。
+ * 3) そのhyperparameterで、ランダムフーリエ特徴による回帰を学習する。
+ * 4) 学習したモデルを使って、high-level indictorから、PMパラメータを推定する。
  * 5) 推定値のエラーを計算する。
  */
-void MainWindow::onInversePMByHierarchicalLR() {
-	const int N = 2000;
+void MainWindow::onInversePMByRandomFourierFeatures() {
+	RandomFourierRegression rff(1000, 8, 50, 500);
+	evaluateInverseModel(rff, generateDataset(2000, 3), "samples/rff.dat");
+}
 
-	if (!QDir("samples").exists()) QDir().mkdir("samples");
+/**
+ * k近傍法を使って、high-level indicatorから対応するPMパラメータを推定する。
+ *
+ * 1) 2000個のサンプルを生成して、high-level indicatorを計算する。
+ * 2) high-level indicatorを、KD-treeで索引付けする。
+ * 3) 新しく200個のサンプルを生成し、近傍のサンプルのPMパラメータを距離で重み付けして平均し、PMパラメータを推定する。
+ * 4) 推定値のエラーを計算する。
+ * 学習データ自身で評価すると、距離0の自分自身が必ず見つかってエラーがほぼ0になるので、学習に使っていないサンプルで評価する。
+ */
+void MainWindow::onInversePMByKNN() {
+	int seed = 0;
+	KNNRegression knn(5);
+	int64 start = cv::getTickCount();
+	knn.fit(generateDataset(2000, 3, &seed));
+	cout << "Training time: " << Evaluation::seconds(start) << " sec" << endl;
+	knn.save("samples/knn.dat");
+
+	Dataset tests = generateDataset(200, 3, &seed);
+	start = cv::getTickCount();
+	cv::Mat_<double> X_hat = knn.predictBatch(tests.Y);
+	cv::Mat_<double> error, error2;
+	Evaluation::rmse(X_hat, tests.X, knn.getMaxX(), error, error2);
+	double time = Evaluation::seconds(start);
+
+	Evaluation::print(error, error2, time);
+}
 
-	cout << "Generating samples..." << endl;
+/**
+ * サンプルをバッチごとに生成して、high-level indicatorのHNSWインデックスに追加していく。
+ * インデックスが既にあれば開いて、続きから追加する。
+ * 最後に、新しく生成したサンプルをクエリとして、最も近いサンプルのPMパラメータで推定し、
+ * 探索時間とエラーを表示する。
+ */
+void MainWindow::onBuildExampleIndex() {
+	const int numBatches = 10;
+	const int batchSize = 1000;
+	const string indexFile = "samples/examples.hnsw";
 
-	cv::Mat_<double> dataX(N, 14);
-	cv::Mat_<double> dataY(N, 16);
-	int seed_count = 0;
-	for (int iter = 0; iter < N; ++iter) {
-		cout << iter << endl;
+	if (!QDir("samples").exists()) QDir().mkdir("samples");
 
-		while (true) {
-			glWidget->tree->randomInit(seed_count++);
-			if (glWidget->tree->generate()) break;
+	// 既存のインデックスと、次に使う乱数のシードを読み込む (開けない場合は、作り直す)
+	cv::Ptr<HNSWIndex> index;
+	int seed = 0;
+	if (QFile::exists(QString::fromLocal8Bit(indexFile.c_str()))) {
+		try {
+			index = new HNSWIndex(indexFile);
+			seed = index->getNextSeed();
+		} catch (const cv::Exception& e) {
+			cout << e.err << endl;
+			cout << "The index is rebuilt from scratch." << endl;
 		}
+	}
 
-		vector<float> params = glWidget->tree->getParams();
-		for (int col = 0; col < dataX.cols; ++col) {
-			dataX(iter, col) = params[col];
-		}
+	for (int b = 0; b < numBatches; ++b) {
+		Dataset dataset = generateDataset(batchSize, 3, &seed);
+		cv::Mat_<float> stats, params;
+		dataset.Y.convertTo(stats, CV_32F);
+		dataset.X.convertTo(params, CV_32F);
 
-		vector<float> statistics = glWidget->tree->getStatistics3();
-		for (int col = 0; col < dataY.cols - 1; ++col) {
-			dataY(iter, col) = statistics[col];
+		// 最初のバッチから、距離の計算に使う正規化のパラメータを決める
+		if (index.empty()) {
+			cv::Mat_<float> mu, scale;
+			cv::reduce(stats, mu, 0, CV_REDUCE_AVG);
+			cv::reduce(cv::abs(stats - cv::repeat(mu, stats.rows, 1)), scale, 0, CV_REDUCE_MAX);
+
+			index = new HNSWIndex(indexFile, stats.cols, params.cols);
+			index->setNormalization(mu, scale);
 		}
-		dataY(iter, dataY.cols - 1) = 1; // 定数項
+
+		int64 start = cv::getTickCount();
+		index->addBatch(stats, params);
+		cout << "Indexed " << index->size() << " examples (" << Evaluation::seconds(start) << " sec)" << endl;
+	}
+	index->setNextSeed(seed);
+	index->flush();
+
+	// 新しいサンプルで、最も近いサンプルのPMパラメータを推定する
+	Dataset dataset = generateDataset(1000, 3, &seed);
+	cv::Mat_<float> queries;
+	dataset.Y.convertTo(queries, CV_32F);
+
+	index->setEf(50);
+	int64 start = cv::getTickCount();
+	cv::Mat_<int> indices;
+	cv::Mat_<float> dists;
+	index->search(queries, 1, indices, dists);
+	double time = Evaluation::seconds(start);
+
+	cv::Mat_<double> X_hat(dataset.size(), dataset.X.cols);
+	for (int r = 0; r < dataset.size(); ++r) {
+		cv::Mat_<double> x_hat = X_hat.row(r);
+		index->payload(indices(r, 0)).convertTo(x_hat, CV_64F);
 	}
 
-	glWidget->update();
-	controlWidget->update();
+	cv::Mat_<double> muX, maxX;
+	cv::reduce(dataset.X, muX, 0, CV_REDUCE_AVG);
+	cv::reduce(cv::abs(dataset.X - cv::repeat(muX, dataset.size(), 1)), maxX, 0, CV_REDUCE_MAX);
+	cv::Mat_<double> error, error2;
+	Evaluation::rmse(X_hat, dataset.X, maxX, error, error2);
 
-	// normalization
-	cv::Mat_<double> muX, muY;
-	cv::reduce(dataX, muX, 0, CV_REDUCE_AVG);
-	cv::reduce(dataY, muY, 0, CV_REDUCE_AVG);
-	cv::Mat_<double> dataX2 = dataX - cv::repeat(muX, N, 1);
-	cv::Mat_<double> dataY2 = dataY - cv::repeat(muY, N, 1);
-
-	// [-1, 1]にする
-	cv::Mat_<double> maxX, maxY;
-	cv::reduce(cv::abs(dataX2), maxX, 0, CV_REDUCE_MAX);
-	cv::reduce(cv::abs(dataY2), maxY, 0, CV_REDUCE_MAX);
-	dataX2 /= cv::repeat(maxX, N, 1);
-	dataY2 /= cv::repeat(maxY, N, 1);
-
-	// 定数項
-	for (int r = 0; r < N; ++r) {
-		dataY2(r, dataY2.cols - 1) = 1;
+	Evaluation::print(error, error2, time);
+	cout << "Query time: " << time * 1000.0 / dataset.size() << " msec per sample" << endl;
+}
+
+/**
+ * CMA-ESを使って、high-level indicatorから対応するPMパラメータを探索する。
+ *
+ * 1) 2000個のサンプルを生成して、Linear regressionを学習する。
+ * 2) 新しく10個のサンプルを生成し、それぞれのhigh-level indicatorを目標とする。
+ * 3) 回帰の推定値を初期値として、CMA-ESで探索する (比較のため、初期値なしでも探索する)。
+ * 4) 目標の木と、探索したPMパラメータで生成した木の画像を保存し、エラーと世代数を表示する。
+ */
+void MainWindow::onInversePMByCMAES() {
+	const int numTargets = 10;
+
+	int seed = 0;
+	Dataset dataset = generateDataset(2000, 3, &seed);
+	LinearRegression lr;
+	lr.fit(dataset);
+
+	// エラーの計算に使う、high-level indicatorのスケール
+	cv::Mat_<double> muY, scaleY;
+	cv::reduce(dataset.Y, muY, 0, CV_REDUCE_AVG);
+	cv::reduce(cv::abs(dataset.Y - cv::repeat(muY, dataset.size(), 1)), scaleY, 0, CV_REDUCE_MAX);
+
+	CMAESSolver solver(scaleY);
+	solver.setTolerance(0.01);
+	solver.setTimeBudget(30.0);
+
+	Dataset targets = generateDataset(numTargets, 3, &seed);
+	double totalError[2] = { 0.0, 0.0 };
+	int totalGenerations[2] = { 0, 0 };
+	for (int iter = 0; iter < numTargets; ++iter) {
+		cv::Mat_<double> target = targets.Y.row(iter);
+
+		// 回帰の推定値から探索する
+		int64 start = cv::getTickCount();
+		cv::Mat_<double> x_hat = solver.solve(target, lr.predict(target), 0.1);
+		cout << "Target " << iter << ": error " << solver.getError() << ", " << solver.getGenerations() << " generations, " << Evaluation::seconds(start) << " sec" << endl;
+		totalError[0] += solver.getError();
+		totalGenerations[0] += solver.getGenerations();
+
+		glWidget->tree->setParams(targets.X.row(iter));
+		glWidget->updateGL();
+		QString fileName = "samples/" + QString::number(iter) + ".png";
+		glWidget->grabFrameBuffer().save(fileName);
+
+		glWidget->tree->setParams(x_hat);
+		glWidget->updateGL();
+		fileName = "samples/reversed_" + QString::number(iter) + ".png";
+		glWidget->grabFrameBuffer().save(fileName);
+
+		// 初期値なしで探索する
+		solver.solve(target);
+		totalError[1] += solver.getError();
+		totalGenerations[1] += solver.getGenerations();
 	}
 
-	vector<cv::Mat_<float> > clusterX, clusterX2, clusterY2;
-	vector<vector<int> > clusterIndices;
-	{
-		cv::Mat samplesX, samplesX2, samplesY2;
-		dataX.convertTo(samplesX, CV_32F);
-		dataX2.convertTo(samplesX2, CV_32F);
-		dataY2.convertTo(samplesY2, CV_32F);
-		vector<int> indices(N);
-		for (int i = 0; i < N; ++i) indices[i] = i;
-		DataPartition::partition(samplesX2, samplesY2, samplesX, indices, 20, clusterX2, clusterY2, clusterX, clusterIndices);
-
-		for (int i = 0; i < clusterX.size(); ++i) {
-			cout << clusterX[i].rows << endl;
-		}
+	cout << "With regression start: error " << totalError[0] / numTargets << ", " << (double)totalGenerations[0] / numTargets << " generations" << endl;
+	cout << "Without regression start: error " << totalError[1] / numTargets << ", " << (double)totalGenerations[1] / numTargets << " generations" << endl;
+}
+
+/**
+ * Levenberg-Marquardt法を使って、回帰で推定したPMパラメータを改善する。
+ *
+ * 1) 2000個のサンプルを生成して、Linear regressionを学習する。
+ * 2) 新しく10個のサンプルを生成し、それぞれのhigh-level indicatorを目標とする。
+ * 3) 回帰の推定値を初期値として、差分で求めたヤコビ行列を使って改善する。
+ * 4) 目標の木と、改善したPMパラメータで生成した木の画像を保存し、改善前後のエラーを表示する。
+ */
+void MainWindow::onInversePMByLevenbergMarquardt() {
+	const int numTargets = 10;
+
+	int seed = 0;
+	Dataset dataset = generateDataset(2000, 3, &seed);
+	LinearRegression lr;
+	lr.fit(dataset);
+
+	// エラーの計算に使う、high-level indicatorのスケール
+	cv::Mat_<double> muY, scaleY;
+	cv::reduce(dataset.Y, muY, 0, CV_REDUCE_AVG);
+	cv::reduce(cv::abs(dataset.Y - cv::repeat(muY, dataset.size(), 1)), scaleY, 0, CV_REDUCE_MAX);
+
+	LevenbergMarquardtSolver solver(scaleY);
+	solver.setTolerance(0.01);
+	solver.setMaxIterations(10);
+
+	Dataset targets = generateDataset(numTargets, 3, &seed);
+	double totalError[2] = { 0.0, 0.0 };
+	int totalIterations = 0;
+	for (int iter = 0; iter < numTargets; ++iter) {
+		cv::Mat_<double> target = targets.Y.row(iter);
+
+		// 回帰の推定値を初期値として改善する
+		int64 start = cv::getTickCount();
+		cv::Mat_<double> x_hat = solver.solve(target, lr.predict(target));
+		cout << "Target " << iter << ": error " << solver.getInitialError() << " -> " << solver.getError() << ", " << solver.getIterations() << " iterations, " << Evaluation::seconds(start) << " sec" << endl;
+		totalError[0] += solver.getInitialError();
+		totalError[1] += solver.getError();
+		totalIterations += solver.getIterations();
+
+		glWidget->tree->setParams(targets.X.row(iter));
+		glWidget->updateGL();
+		QString fileName = "samples/" + QString::number(iter) + ".png";
+		glWidget->grabFrameBuffer().save(fileName);
+
+		glWidget->tree->setParams(x_hat);
+		glWidget->updateGL();
+		fileName = "samples/reversed_" + QString::number(iter) + ".png";
+		glWidget->grabFrameBuffer().save(fileName);
 	}
 
-	cv::Mat_<double> error = cv::Mat_<double>::zeros(1, dataX2.cols);
-	cv::Mat_<double> error2 = cv::Mat_<double>::zeros(1, dataX2.cols);
-	for (int clu = 0; clu < clusterX.size(); ++clu) {
-		cv::Mat_<double> dataX;
-		clusterX[clu].convertTo(dataX, CV_64F);
-		cv::Mat_<double> dataX2;
-		clusterX2[clu].convertTo(dataX2, CV_64F);
-		cv::Mat_<double> dataY2;
-		clusterY2[clu].convertTo(dataY2, CV_64F);
-
-		// Linear regressionにより、Wを求める（yW = x より、W = y^+ x)
-		cv::Mat_<double> W = dataY2.inv(cv::DECOMP_SVD) * dataX2;
-
-		// reverseで木を生成する
-		for (int iter = 0; iter < dataX2.rows; ++iter) {
-			cv::Mat x2_hat = dataY2.row(iter) * W;
-			cv::Mat x_hat = x2_hat.mul(maxX) + muX;
-			error += (dataX2.row(iter) - x2_hat).mul(dataX2.row(iter) - x2_hat);
-			error2 += (dataX.row(iter) - x_hat).mul(dataX.row(iter) - x_hat);
-
-			if (clusterIndices[clu][iter] % 100 == 0) {
-				glWidget->tree->setParams(dataX.row(iter));
+	cout << "Regression: error " << totalError[0] / numTargets << endl;
+	cout << "Levenberg-Marquardt: error " << totalError[1] / numTargets << ", " << (double)totalIterations / numTargets << " iterations" << endl;
+}
+
+/**
+ * forwardの代理モデルを使って、CMA-ESでhigh-level indicatorから対応するPMパラメータを探索する。
+ *
+ * 1) 2000個のサンプルを生成して、PMパラメータから統計情報への代理モデルを学習する。
+ * 2) 新しく200個のサンプルで、代理モデルと実際の生成の精度と時間を比較する。
+ * 3) 新しく10個のサンプルのhigh-level indicatorを目標として、代理モデルあり/なしでCMA-ESで探索する。
+ * 4) 探索したPMパラメータから実際に木を生成してエラーを計算し、時間とともに表示する。
+ */
+void MainWindow::onInversePMByCMAESWithSurrogate() {
+	const int numTests = 200;
+	const int numTargets = 10;
+
+	int seed = 0;
+	Dataset dataset = generateDataset(2000, 3, &seed);
+	int64 start = cv::getTickCount();
+	SurrogateSimulator surrogate(3);
+	surrogate.fit(dataset);
+	cout << "Surrogate training: " << Evaluation::seconds(start) << " sec" << endl;
+
+	// エラーの計算に使う、high-level indicatorのスケール
+	cv::Mat_<double> muY, scaleY;
+	cv::reduce(dataset.Y, muY, 0, CV_REDUCE_AVG);
+	cv::reduce(cv::abs(dataset.Y - cv::repeat(muY, dataset.size(), 1)), scaleY, 0, CV_REDUCE_MAX);
+	scaleY.setTo(1.0, scaleY == 0);
+
+	// 代理モデルの精度と時間
+	Dataset tests = generateDataset(numTests, 3, &seed);
+	start = cv::getTickCount();
+	cv::Mat_<double> S_hat, uncertainty;
+	surrogate.predict(tests.X, S_hat, uncertainty);
+	double timeSurrogate = Evaluation::seconds(start);
+	start = cv::getTickCount();
+	cv::Mat_<double> S;
+	cv::Mat_<uchar> valid;
+	ForwardSimulator::simulate(tests.X, S, valid);
+	double timeSimulator = Evaluation::seconds(start);
+
+	cv::Mat_<double> error, error2;
+	Evaluation::rmse(S_hat, tests.Y, scaleY, error, error2);
+	Evaluation::print(error, error2, timeSurrogate);
+	cout << "Mean uncertainty: " << cv::mean(uncertainty)[0] << endl;
+	cout << "Surrogate: " << timeSurrogate * 1000.0 / numTests << " msec per sample, generator: " << timeSimulator * 1000.0 / numTests << " msec per sample" << endl;
+
+	// 代理モデルあり/なしで、CMA-ESで探索する
+	CMAESSolver solver(scaleY);
+	solver.setTolerance(0.01);
+	solver.setTimeBudget(30.0);
+
+	Dataset targets = generateDataset(numTargets, 3, &seed);
+	double totalError[2] = { 0.0, 0.0 };
+	double totalTime[2] = { 0.0, 0.0 };
+	for (int iter = 0; iter < numTargets; ++iter) {
+		cv::Mat_<double> target = targets.Y.row(iter);
+
+		for (int k = 0; k < 2; ++k) {
+			solver.setSurrogate(k == 0 ? &surrogate : NULL);
+			start = cv::getTickCount();
+			cv::Mat_<double> x_hat = solver.solve(target);
+			totalTime[k] += Evaluation::seconds(start);
+
+			// 代理モデルの推定値ではなく、実際に生成した木でエラーを計算する
+			cv::Mat_<double> stats;
+			if (ForwardSimulator::simulate(x_hat, stats)) {
+				totalError[k] += sqrt(cv::norm((stats - target) / scaleY, cv::NORM_L2SQR) / target.cols);
+			} else {
+				totalError[k] += 1.0;
+			}
+
+			if (k == 0) {
+				glWidget->tree->setParams(targets.X.row(iter));
 				glWidget->updateGL();
-				QString fileName = "samples/" + QString::number(clusterIndices[clu][iter] / 100) + ".png";
+				QString fileName = "samples/" + QString::number(iter) + ".png";
 				glWidget->grabFrameBuffer().save(fileName);
 
 				glWidget->tree->setParams(x_hat);
 				glWidget->updateGL();
-				fileName = "samples/reversed_" + QString::number(clusterIndices[clu][iter] / 100) + ".png";
+				fileName = "samples/reversed_" + QString::number(iter) + ".png";
 				glWidget->grabFrameBuffer().save(fileName);
 			}
 		}
 	}
 
-	error /= N;
-	error2 /= N;
-	cv::sqrt(error, error);
-	cv::sqrt(error2, error2);
-
-	cout << "Prediction error (normalized):" << endl;
-	cout << error << endl;
-	cout << "Prediction error:" << endl;
-	cout << error2 << endl;
+	cout << "With surrogate: error " << totalError[0] / numTargets << ", " << totalTime[0] / numTargets << " sec (" << surrogate.getNumSimulated() << " of " << surrogate.getNumPredicted() + surrogate.getNumSimulated() << " samples generated)" << endl;
+	cout << "Without surrogate: error " << totalError[1] / numTargets << ", " << totalTime[1] / numTargets << " sec" << endl;
 }
 
 /**
- * ガウス過程を使って、high-level indicatorから対応するPMパラメータを推定する。
+ * ベイズ最適化を使って、high-level indicatorから対応するPMパラメータを探索する。
+ * 学習データを作らずに、目標ごとに数十回の並列生成だけで探索する。
  *
- * 1) 2000個のサンプルを生成して、high-level indicatorを計算する。
- * 2) ガウス過程を使って、high-level indictorから、PMパラメータを推定する。
- * 3) 推定値のエラーを計算する。
+ * 1) 200個のサンプルを生成して、エラーの計算に使うhigh-level indicatorのスケールを求める。
+ * 2) 新しく10個のサンプルを生成し、それぞれのhigh-level indicatorを目標とする。
+ * 3) ベイズ最適化で探索する。
+ * 4) 目標の木と、探索したPMパラメータで生成した木の画像を保存し、エラーと生成回数を表示する。
  */
-void MainWindow::onInversePMByGaussianProcess() {
-	const int N = 2000;
+void MainWindow::onInversePMByBayesianOptimization() {
+	const int numTargets = 10;
+
+	int seed = 0;
+	Dataset dataset = generateDataset(200, 3, &seed);
+
+	// エラーの計算に使う、high-level indicatorのスケール
+	cv::Mat_<double> muY, scaleY;
+	cv::reduce(dataset.Y, muY, 0, CV_REDUCE_AVG);
+	cv::reduce(cv::abs(dataset.Y - cv::repeat(muY, dataset.size(), 1)), scaleY, 0, CV_REDUCE_MAX);
+
+	BayesianOptimizer solver(scaleY);
+	solver.setTolerance(0.01);
+	solver.setTimeBudget(30.0);
+
+	Dataset targets = generateDataset(numTargets, 3, &seed);
+	double totalError = 0.0;
+	int totalEvaluations = 0;
+	for (int iter = 0; iter < numTargets; ++iter) {
+		cv::Mat_<double> target = targets.Y.row(iter);
+
+		int64 start = cv::getTickCount();
+		cv::Mat_<double> x_hat = solver.solve(target);
+		cout << "Target " << iter << ": error " << solver.getError() << ", " << solver.getEvaluations() << " evaluations, " << Evaluation::seconds(start) << " sec" << endl;
+		totalError += solver.getError();
+		totalEvaluations += solver.getEvaluations();
+
+		glWidget->tree->setParams(targets.X.row(iter));
+		glWidget->updateGL();
+		QString fileName = "samples/" + QString::number(iter) + ".png";
+		glWidget->grabFrameBuffer().save(fileName);
+
+		glWidget->tree->setParams(x_hat);
+		glWidget->updateGL();
+		fileName = "samples/reversed_" + QString::number(iter) + ".png";
+		glWidget->grabFrameBuffer().save(fileName);
+	}
 
-	if (!QDir("samples").exists()) QDir().mkdir("samples");
+	cout << "Bayesian optimization: error " << totalError / numTargets << ", " << (double)totalEvaluations / numTargets << " evaluations" << endl;
+}
 
-	cout << "Generating samples..." << endl;
+/**
+ * active learningで学習データを作成し、同じ数のランダムな学習データと比較する。
+ *
+ * 1) 500個のサンプルを生成して、検証データとする。
+ * 2) 予測分散とcommitteeのばらつきのそれぞれで、検証データのエラーが目標を下回るまで学習データを追加する。
+ * 3) 同じ数のランダムな学習データで学習したモデルのエラーと比較する。
+ */
+void MainWindow::onBuildDatasetByActiveLearning() {
+	const double targetError = 0.1;
+	const int maxSamples = 2000;
+
+	// active learningのシードと重ならないようにする
+	int seed = 1000000;
+	Dataset validation = generateDataset(500, 3, &seed);
+	cv::Mat_<double> muX, maxX;
+	cv::reduce(validation.X, muX, 0, CV_REDUCE_AVG);
+	cv::reduce(cv::abs(validation.X - cv::repeat(muX, validation.size(), 1)), maxX, 0, CV_REDUCE_MAX);
+
+	for (int scoring = 0; scoring < 2; ++scoring) {
+		cout << (scoring == ActiveLearner::SCORE_VARIANCE ? "Predictive variance:" : "Committee disagreement:") << endl;
+
+		ActiveLearner learner(3, scoring);
+		learner.setSeed(0);
+		int64 start = cv::getTickCount();
+		Dataset dataset = learner.build(validation, targetError, maxSamples);
+		double error = ActiveLearner::error(learner.predictBatch(validation.Y), validation.X, maxX);
+		cout << "Active learning: " << dataset.size() << " samples, error " << error << ", " << Evaluation::seconds(start) << " sec" << endl;
+
+		// 同じ数のランダムな学習データで比較する
+		int seed2 = 2000000;
+		learner.fit(generateDataset(dataset.size(), 3, &seed2));
+		error = ActiveLearner::error(learner.predictBatch(validation.Y), validation.X, maxX);
+		cout << "Random: " << dataset.size() << " samples, error " << error << endl;
+	}
+}
 
-	cv::Mat_<double> dataX(N, 14);
-	cv::Mat_<double> dataY(N, 16);
-	int seed_count = 0;
-	for (int iter = 0; iter < N; ++iter) {
-		cout << iter << endl;
+/**
+ * 多層パーセプトロンを使って、high-level indicatorから対応するPMパラメータを推定する。
+ *
+ * 1) 2000個のサンプルを生成して、high-level indicatorを計算する。
+ * 2) ミニバッチのAdamで、ネットワークを学習する (勾配は並列に計算する)。
+ * 3) ネットワークを使って、high-level indictorから、PMパラメータを推定する。
+ * 4) 推定値のエラーを計算する。
+ */
+void MainWindow::onInversePMByMLP() {
+	MLPRegression mlp(64, 2, 200, 128);
+	evaluateInverseModel(mlp, generateDataset(2000, 3), "samples/mlp.dat");
+}
 
-		while (true) {
-			glWidget->tree->randomInit(seed_count++);
-			if (glWidget->tree->generate()) break;
-		}
+/**
+ * ランダムフォレストを使って、high-level indicatorから対応するPMパラメータを推定する。
+ *
+ * 1) 2000個のサンプルを生成して、high-level indicatorを計算する。
+ * 2) PMパラメータの列ごとに、ランダムフォレストを並列に学習する。
+ * 3) ランダムフォレストを使って、high-level indictorから、PMパラメータを推定する。
+ * 4) 推定値のエラーと、high-level indicatorの各変数の重要度を表示する。
+ */
+void MainWindow::onInversePMByRandomForest() {
+	RandomForestRegression rf(100, 12, 5);
+	evaluateInverseModel(rf, generateDataset(2000, 3), "samples/random_forest.dat");
+
+	// 全てのPMパラメータで平均した、各変数の重要度
+	cv::Mat_<double> importance;
+	cv::reduce(rf.getImportance(), importance, 1, CV_REDUCE_AVG);
+	cout << "Variable importance:" << endl;
+	cout << importance.t() << endl;
+}
 
-		vector<float> params = glWidget->tree->getParams();
-		for (int col = 0; col < dataX.cols; ++col) {
-			dataX(iter, col) = params[col];
-		}
+/**
+ * hierarchical LRのバギングを使って、high-level indicatorから対応するPMパラメータを推定する。
+ *
+ * 1) 2000個のサンプルを生成して、high-level indicatorを計算する。
+ * 2) 8個のレプリカを、それぞれブートストラップした学習データで並列に学習する。
+ * 3) レプリカの推定値の平均で、high-level indictorから、PMパラメータを推定する。
+ * 4) 推定値のエラーと、新しく200個のサンプルでのレプリカの推定値のばらつきを表示する。
+ */
+void MainWindow::onInversePMByBagging() {
+	const int K = 8;
 
-		vector<float> statistics = glWidget->tree->getStatistics3();
-		for (int col = 0; col < dataY.cols - 1; ++col) {
-			dataY(iter, col) = statistics[col];
-		}
-		dataY(iter, dataY.cols - 1) = 1; // 定数項
+	vector<cv::Ptr<InverseModel> > replicas;
+	for (int k = 0; k < K; ++k) {
+		replicas.push_back(new HierarchicalLR(20));
 	}
+	BaggingRegression bagging(replicas);
+
+	int seed = 0;
+	evaluateInverseModel(bagging, generateDataset(2000, 3, &seed), "samples/bagging.dat");
+
+	Dataset tests = generateDataset(200, 3, &seed);
+	cv::Mat_<double> spread;
+	cv::Mat_<double> X_hat = bagging.predictBatch(tests.Y, spread);
+	cv::Mat_<double> meanSpread;
+	cv::reduce(spread / cv::repeat(bagging.getMaxX(), tests.size(), 1), meanSpread, 0, CV_REDUCE_AVG);
+	cout << "Spread (normalized):" << endl;
+	cout << meanSpread << endl;
+}
 
-	glWidget->update();
-	controlWidget->update();
-
-	// normalization
-	cv::Mat_<double> muX, muY;
-	cv::reduce(dataX, muX, 0, CV_REDUCE_AVG);
-	cv::reduce(dataY, muY, 0, CV_REDUCE_AVG);
-	cv::Mat_<double> dataX2 = dataX - cv::repeat(muX, N, 1);
-	cv::Mat_<double> dataY2 = dataY - cv::repeat(muY, N, 1);
-
-	// [-1, 1]にする
-	cv::Mat_<double> maxX, maxY;
-	cv::reduce(cv::abs(dataX2), maxX, 0, CV_REDUCE_MAX);
-	cv::reduce(cv::abs(dataY2), maxY, 0, CV_REDUCE_MAX);
-	dataX2 /= cv::repeat(maxX, N, 1);
-	dataY2 /= cv::repeat(maxY, N, 1);
-
-	// 定数項
-	for (int r = 0; r < N; ++r) {
-		dataY2(r, dataY2.cols - 1) = 1;
-	}
+/**
+ * 交差検証のグリッドの値から、inverseモデルを作成する。
+ */
+static cv::Ptr<InverseModel> createHierarchicalLR(double minSize) {
+	return new HierarchicalLR((int)minSize);
+}
 
-	cv::Mat_<double> error = cv::Mat_<double>::zeros(1, dataX2.cols);
-	cv::Mat_<double> error2 = cv::Mat_<double>::zeros(1, dataX2.cols);
+static cv::Ptr<InverseModel> createRidgeRegression(double lambda) {
+	return new LinearRegression(lambda);
+}
 
-	GaussianProcess gp(dataY2);
-	for (int iter = 0; iter < dataY2.rows; ++iter) {
-		cout << iter << endl;
+static cv::Ptr<InverseModel> createGaussianProcess(double theta_1) {
+	GaussianProcessRegression* gpr = new GaussianProcessRegression();
+	gpr->setHyperparameters(1.0, theta_1, 0.0, 0.0, 1.0e4);
+	return gpr;
+}
 
-		cv::Mat normalized_x_hat = gp.predict(dataY2.row(iter), dataY2, dataX2);
-		cv::Mat x_hat = normalized_x_hat.mul(maxX) + muX;
+static cv::Ptr<InverseModel> createConjugateGradientGP(double tolerance) {
+	GaussianProcessRegression* gpr = new GaussianProcessRegression();
+	gpr->setHyperparameters(1.0, 4.0, 0.0, 0.0, 1.0e4);
+	if (tolerance > 0) gpr->setConjugateGradient(tolerance, 500);
+	return gpr;
+}
 
-		error += (dataX2.row(iter) - normalized_x_hat).mul(dataX2.row(iter) - normalized_x_hat);
-		error2 += (dataX.row(iter) - x_hat).mul(dataX.row(iter) - x_hat);
+/**
+ * 5-fold交差検証で、inverseモデルのhyperparameterをグリッドサーチする。
+ * 学習データ自身でのエラーではなく、学習に使っていないfoldでのエラーで比較する。
+ *
+ * 1) 2000個のサンプルを生成する (全てのグリッドで共通に使う)。
+ * 2) hierarchical LRのminSize、リッジ回帰のlambda、ガウス過程のtheta_1 (固定)、
+ *    共役勾配法で解くガウス過程の許容残差 (0はコレスキー分解) のそれぞれについて、
+ *    (値, fold) の全ての組を並列に学習、評価する。
+ * 3) 値ごとのエラーの平均、標準偏差、学習時間を表として表示する。
+ */
+void MainWindow::onCrossValidation() {
+	const int numFolds = 5;
+
+	Dataset dataset = generateDataset(2000, 3);
+	cv::Mat_<double> errors, times;
+
+	int64 start = cv::getTickCount();
+	const double minSizes[] = { 10, 20, 40, 80, 160 };
+	vector<double> values(minSizes, minSizes + 5);
+	CrossValidation::run(dataset, numFolds, createHierarchicalLR, values, errors, times);
+	CrossValidation::print("minSize", values, errors, times);
+
+	const double lambdas[] = { 0, 1.0e-4, 1.0e-3, 1.0e-2, 1.0e-1, 1 };
+	values.assign(lambdas, lambdas + 6);
+	CrossValidation::run(dataset, numFolds, createRidgeRegression, values, errors, times);
+	CrossValidation::print("lambda", values, errors, times);
+
+	const double thetas[] = { 1, 4, 16, 64 };
+	values.assign(thetas, thetas + 4);
+	CrossValidation::run(dataset, numFolds, createGaussianProcess, values, errors, times);
+	CrossValidation::print("theta_1", values, errors, times);
+
+	const double tolerances[] = { 0, 1.0e-1, 1.0e-2, 1.0e-3, 1.0e-4 };
+	values.assign(tolerances, tolerances + 5);
+	CrossValidation::run(dataset, numFolds, createConjugateGradientGP, values, errors, times);
+	CrossValidation::print("CG tolerance", values, errors, times);
+
+	cout << "Total time: " << Evaluation::seconds(start) << " sec" << endl;
+}
 
-		if (iter % 100 == 0) {
-			glWidget->tree->setParams(dataX.row(iter));
-			glWidget->updateGL();
-			QString fileName = "samples/" + QString::number(iter / 100) + ".png";
-			glWidget->grabFrameBuffer().save(fileName);
+/**
+ * 交差検証のグリッドの値 (残す分散の割合) から、whiteningを使うinverseモデルを作成する。
+ */
+static cv::Ptr<InverseModel> createWhitenedKNN(double energy) {
+	KNNRegression* knn = new KNNRegression();
+	knn->setWhitening(energy);
+	return knn;
+}
 
+static cv::Ptr<InverseModel> createWhitenedGP(double energy) {
+	GaussianProcessRegression* gpr = new GaussianProcessRegression();
+	gpr->setHyperparameters(1.0, 4.0, 0.0, 0.0, 1.0e4);
+	gpr->setWhitening(energy);
+	return gpr;
+}
 
-			glWidget->tree->setParams(x_hat);
-			glWidget->updateGL();
-			fileName = "samples/reversed_" + QString::number(iter / 100) + ".png";
-			glWidget->grabFrameBuffer().save(fileName);
-		}
+/**
+ * high-level indicatorのPCA/whiteningの効果を、5-fold交差検証で比較する。
+ *
+ * 1) 3種類目の統計情報 (15次元) で、2000個のサンプルを生成する。
+ * 2) 残す分散の割合 (0はwhiteningなし) ごとに、主成分の数を表示する。
+ * 3) kNNとガウス過程 (hyperparameterは固定) について、割合ごとのエラーと学習時間を表として表示する。
+ */
+void MainWindow::onCompareWhitening() {
+	const int numFolds = 5;
+
+	Dataset dataset = generateDataset(2000, 3);
+	cv::Mat_<double> errors, times;
+
+	const double energies[] = { 0, 0.9, 0.95, 0.99, 0.999 };
+	vector<double> values(energies, energies + 5);
+	for (int i = 0; i < values.size(); ++i) {
+		LinearRegression lr;
+		lr.setWhitening(values[i]);
+		lr.fit(dataset);
+		int dims = lr.getWhitening().empty() ? dataset.Y.cols : lr.getWhitening().dims();
+		cout << "energy: " << values[i] << ", dims: " << dims << " / " << dataset.Y.cols << endl;
 	}
 
-	error /= N;
-	error2 /= N;
-	cv::sqrt(error, error);
-	cv::sqrt(error2, error2);
+	int64 start = cv::getTickCount();
+	CrossValidation::run(dataset, numFolds, createWhitenedKNN, values, errors, times);
+	CrossValidation::print("energy (KNN)", values, errors, times);
+
+	CrossValidation::run(dataset, numFolds, createWhitenedGP, values, errors, times);
+	CrossValidation::print("energy (GP)", values, errors, times);
+
+	cout << "Total time: " << Evaluation::seconds(start) << " sec" << endl;
+}
 
-	cout << "Prediction error (normalized):" << endl;
-	cout << error << endl;
-	cout << "Prediction error:" << endl;
-	cout << error2 << endl;
+/**
+ * 共分散行列をファイル上のタイル行列で分解するガウス過程を、メモリ上で分解する場合と比較する。
+ *
+ * 1) 4000個のサンプルを生成して、high-level indicatorを計算する。
+ * 2) hyperparameterを固定して、タイル行列で分解するガウス過程を学習し、エラーを計算する。
+ * 3) 同じhyperparameterで、メモリ上で分解するガウス過程を学習し、学習時間と推定値の差を表示する。
+ */
+void MainWindow::onInversePMByOutOfCoreGaussianProcess() {
+	Dataset dataset = generateDataset(4000, 3);
+
+	GaussianProcessRegression tiled;
+	tiled.setHyperparameters(1.0, 4.0, 0.0, 0.0, 1.0e4);
+	tiled.setOutOfCore("samples/gaussian_process.tiles", 256);
+	evaluateInverseModel(tiled, dataset, "samples/gaussian_process_tiled.dat");
+
+	GaussianProcessRegression inMemory;
+	inMemory.setHyperparameters(1.0, 4.0, 0.0, 0.0, 1.0e4);
+	int64 start = cv::getTickCount();
+	inMemory.fit(dataset);
+	cout << "Training time (in memory): " << Evaluation::seconds(start) << " sec" << endl;
+
+	double diff = cv::norm(tiled.predictBatch(dataset.Y), inMemory.predictBatch(dataset.Y), cv::NORM_INF);
+	cout << "Max difference from in-memory GP: " << diff << endl;
 }
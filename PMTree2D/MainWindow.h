@@ -5,6 +5,8 @@
 #include "ui_MainWindow.h"
 #include "GLWidget3D.h"
 #include "ControlWidget.h"
+#include "Dataset.h"
+#include "InverseModel.h"
 
 class MainWindow : public QMainWindow {
 	Q_OBJECT
@@ -18,6 +20,8 @@ public:
 	MainWindow(QWidget *parent = 0, Qt::WFlags flags = 0);
 	
 	void saveImage();
+	Dataset generateDataset(int N, int statistics, int* seed = NULL);
+	void evaluateInverseModel(InverseModel& model, const Dataset& dataset, const string& modelFile);
 
 public slots:
 	void onSaveImage();
@@ -29,6 +33,20 @@ public slots:
 	void onInversePMByLinearRegression3();
 	void onInversePMByHierarchicalLR();
 	void onInversePMByGaussianProcess();
+	void onInversePMByRandomFourierFeatures();
+	void onInversePMByKNN();
+	void onBuildExampleIndex();
+	void onInversePMByCMAES();
+	void onInversePMByLevenbergMarquardt();
+	void onInversePMByCMAESWithSurrogate();
+	void onInversePMByBayesianOptimization();
+	void onBuildDatasetByActiveLearning();
+	void onInversePMByMLP();
+	void onInversePMByRandomForest();
+	void onInversePMByBagging();
+	void onCrossValidation();
+	void onCompareWhitening();
+	void onInversePMByOutOfCoreGaussianProcess();
 };
 
 #endif // MAINWINDOW_H
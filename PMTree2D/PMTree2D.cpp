@@ -45,6 +45,8 @@ PMTree2D::PMTree2D() {
 	ratio[2] = 0.5;
 
 	colorStem = QColor(30, 162, 0);
+
+	headless = false;
 }
 
 /**
@@ -163,22 +165,14 @@ void PMTree2D::randomInit(int seed) {
 	std::seed_seq seq(seeds.begin(), seeds.end());
 	mt.seed(seq);
 
-	base[0] = genRand(0, 0.5);
-	curve[0] = genRand(-30, 30);
-	curveV[0] = genRand(0, 100);
-
-	base[1] = genRand(0, 0.5);
-	curve[1] = genRand(-110, 110);
-	curveV[1] = genRand(0, 100);
-	branches[1] = genRand(10, 40);
-	downAngle[1] = genRand(20, 70);
-	ratio[1] = genRand(0.3, 0.7);
-
-	curve[2] = genRand(-110, 110);
-	curveV[2] = genRand(0, 100);
-	branches[2] = genRand(10, 40);
-	downAngle[2] = genRand(10, 50);
-	ratio[2] = genRand(0.3, 0.7);
+	// 各パラメータを、getParamRange()の範囲から、getParams()の並びの順に生成する
+	vector<float> lower, upper;
+	getParamRange(lower, upper);
+	cv::Mat_<float> params(1, lower.size());
+	for (int i = 0; i < lower.size(); ++i) {
+		params(0, i) = genRand(lower[i], upper[i]);
+	}
+	setParams(params);
 }
 
 /**
@@ -230,6 +224,39 @@ vector<float> PMTree2D::getParams() {
 	return ret;
 }
 
+/**
+ * randomInit()で生成する各パラメータの範囲を返却する。
+ * 並びは、getParams()と同じ。randomInit()も、この範囲を使う。
+ *
+ * @param lower [OUT]	下限
+ * @param upper [OUT]	上限
+ */
+void PMTree2D::getParamRange(vector<float>& lower, vector<float>& upper) {
+	const float range[14][2] = {
+		{ 0, 0.5 }, { -30, 30 }, { 0, 100 },
+		{ 0, 0.5 }, { -110, 110 }, { 0, 100 }, { 10, 40 }, { 20, 70 }, { 0.3, 0.7 },
+		{ -110, 110 }, { 0, 100 }, { 10, 40 }, { 10, 50 }, { 0.3, 0.7 }
+	};
+
+	lower.resize(14);
+	upper.resize(14);
+	for (int i = 0; i < 14; ++i) {
+		lower[i] = range[i][0];
+		upper[i] = range[i][1];
+	}
+}
+
+/**
+ * 指定されたパラメータが整数値かどうかを返却する (curve、curveV、branches、downAngle)。
+ * setParams()では、小数部は切り捨てられる。
+ *
+ * @param index		パラメータのインデックス (getParams()の並び)
+ * @return			true - 整数値 / false - 実数値
+ */
+bool PMTree2D::isIntegerParam(int index) {
+	return index != 0 && index != 3 && index != 8 && index != 13;
+}
+
 vector<float> PMTree2D::getStatistics1() {
 	vector<float> ret(3);
 	ret[0] = stats.maxY;
@@ -277,6 +304,38 @@ vector<float> PMTree2D::getStatistics3() {
 	return ret;
 }
 
+/**
+ * 指定された種類の統計情報を返却する。
+ *
+ * @param statistics	1 - getStatistics1() / 2 - getStatistics2() / 3 - getStatistics3()
+ * @return				統計情報
+ */
+vector<float> PMTree2D::getStatistics(int statistics) {
+	if (statistics == 1) {
+		return getStatistics1();
+	} else if (statistics == 2) {
+		return getStatistics2();
+	} else {
+		return getStatistics3();
+	}
+}
+
+/**
+ * 指定された種類の統計情報の次元数を返却する。
+ *
+ * @param statistics	1 - getStatistics1() / 2 - getStatistics2() / 3 - getStatistics3()
+ * @return				次元数
+ */
+int PMTree2D::numStatistics(int statistics) {
+	if (statistics == 1) {
+		return 3;
+	} else if (statistics == 2) {
+		return 11;
+	} else {
+		return 15;
+	}
+}
+
 void PMTree2D::generateStem(int level, glm::mat4 modelMat, float radius, float length) {
 	float segment_length = length / curveRes;
 
@@ -358,14 +417,17 @@ void PMTree2D::drawQuad(const glm::mat4& modelMat, float top, float base, float
 	p3 = modelMat * p3;
 	p4 = modelMat * p4;
 
-	glBegin(GL_QUADS);
-	glNormal3f(0, 0, 1);
-	glColor3f(color.redF(), color.greenF(), color.blueF());
-	glVertex3f(p1.x, p1.y, p1.z);
-	glVertex3f(p2.x, p2.y, p2.z);
-	glVertex3f(p3.x, p3.y, p3.z);
-	glVertex3f(p4.x, p4.y, p4.z);
-	glEnd();
+	// headlessの場合は、統計情報だけを計算する (OpenGLのコンテキストがないスレッドからも生成できる)
+	if (!headless) {
+		glBegin(GL_QUADS);
+		glNormal3f(0, 0, 1);
+		glColor3f(color.redF(), color.greenF(), color.blueF());
+		glVertex3f(p1.x, p1.y, p1.z);
+		glVertex3f(p2.x, p2.y, p2.z);
+		glVertex3f(p3.x, p3.y, p3.z);
+		glVertex3f(p4.x, p4.y, p4.z);
+		glEnd();
+	}
 
 	// 統計情報を更新
 	{
@@ -42,6 +42,7 @@ public:
 
 	std::mt19937 mt;
 	PMTree2DStats stats;
+	bool headless;
 	
 public:
 	PMTree2D();
@@ -53,6 +54,11 @@ public:
 	vector<float> getStatistics1();
 	vector<float> getStatistics2();
 	vector<float> getStatistics3();
+	vector<float> getStatistics(int statistics);
+
+	static int numStatistics(int statistics);
+	static void getParamRange(vector<float>& lower, vector<float>& upper);
+	static bool isIntegerParam(int index);
 
 private:
 	void generateStem(int level, glm::mat4 modelMat, float radius, float length);
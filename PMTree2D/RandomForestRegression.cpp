@@ -0,0 +1,181 @@
+﻿#include "RandomForestRegression.h"
+#include <QByteArray>
+
+/**
+ * PMパラメータの列ごとに、ランダムフォレストを並列に学習する。
+ */
+class ForestTrainer : public cv::ParallelLoopBody {
+private:
+	RandomForestRegression* rf;
+	const cv::Mat_<float>& F;
+	const cv::Mat_<float>& T;
+
+public:
+	ForestTrainer(RandomForestRegression* rf, const cv::Mat_<float>& F, const cv::Mat_<float>& T) : rf(rf), F(F), T(T) {}
+
+	void operator()(const cv::Range& range) const {
+		// 全ての変数と応答を連続値として扱う (回帰)
+		cv::Mat varType(F.cols + 1, 1, CV_8U, cv::Scalar(CV_VAR_ORDERED));
+		CvRTParams params(rf->maxDepth, rf->minSampleCount, 0.0f, false, 16, NULL, true, 0, rf->numTrees, 0.01f, CV_TERMCRIT_ITER);
+
+		for (int c = range.start; c < range.end; ++c) {
+			cv::Mat_<float> responses = T.col(c).clone();
+			rf->forests[c] = new CvRTrees();
+			rf->forests[c]->train(F, CV_ROW_SAMPLE, responses, cv::Mat(), cv::Mat(), varType, cv::Mat(), params);
+
+			cv::Mat_<double> imp;
+			rf->forests[c]->getVarImportance().convertTo(imp, CV_64F);
+			cv::Mat_<double> col = rf->importance.col(c);
+			cv::Mat_<double>(imp.reshape(1, F.cols)).copyTo(col);
+		}
+	}
+};
+
+/**
+ * クエリごとに、各列のランダムフォレストで並列に推定する。
+ */
+class ForestPredictor : public cv::ParallelLoopBody {
+private:
+	const RandomForestRegression* rf;
+	const cv::Mat_<float>& F;
+	cv::Mat_<double>& X2_hat;
+
+public:
+	ForestPredictor(const RandomForestRegression* rf, const cv::Mat_<float>& F, cv::Mat_<double>& X2_hat) : rf(rf), F(F), X2_hat(X2_hat) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int r = range.start; r < range.end; ++r) {
+			cv::Mat_<float> f = F.row(r);
+			for (int c = 0; c < X2_hat.cols; ++c) {
+				X2_hat(r, c) = rf->forests[c]->predict(f);
+			}
+		}
+	}
+};
+
+/**
+ * ランダムフォレストによるinverseマッピング (OpenCVのCvRTreesを使用)。
+ * CvRTreesは1出力の回帰なので、PMパラメータの列ごとにフォレストを学習し、列ごとに並列に学習する。
+ * 各列について、high-level indicatorの変数の重要度も計算する。
+ *
+ * @param numTrees			各フォレストの木の数
+ * @param maxDepth			木の最大の深さ
+ * @param minSampleCount	葉のノードの最小サンプル数
+ */
+RandomForestRegression::RandomForestRegression(int numTrees, int maxDepth, int minSampleCount) {
+	this->numTrees = numTrees;
+	this->maxDepth = maxDepth;
+	this->minSampleCount = minSampleCount;
+}
+
+/**
+ * 正規化したhigh-level indicatorから、正規化したPMパラメータの各列へのランダムフォレストを学習する。
+ *
+ * @param dataset		学習データ
+ */
+void RandomForestRegression::fit(const Dataset& dataset) {
+	cv::Mat_<double> X2, Y2;
+	normalize(dataset, X2, Y2);
+
+	cv::Mat_<float> F = toFeatures(Y2);
+	cv::Mat_<float> T;
+	X2.convertTo(T, CV_32F);
+
+	forests.clear();
+	forests.resize(T.cols);
+	importance = cv::Mat_<double>::zeros(F.cols, T.cols);
+	cv::parallel_for_(cv::Range(0, T.cols), ForestTrainer(this, F, T));
+}
+
+/**
+ * 複数のhigh-level indicatorから、PMパラメータをまとめて推定する。
+ *
+ * @param Y		high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @return		PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> RandomForestRegression::predictBatch(const cv::Mat_<double>& Y) const {
+	cv::Mat_<float> F = toFeatures(normalizeY(Y));
+	cv::Mat_<double> X2_hat(F.rows, forests.size());
+	cv::parallel_for_(cv::Range(0, F.rows), ForestPredictor(this, F, X2_hat));
+
+	return denormalizeX(X2_hat);
+}
+
+/**
+ * high-level indicatorの各変数の重要度を返却する。
+ * 各行がhigh-level indicatorの各列、各列がPMパラメータの各列に対応する (各列の和は1)。
+ */
+const cv::Mat_<double>& RandomForestRegression::getImportance() const {
+	return importance;
+}
+
+string RandomForestRegression::tag() const {
+	return "RF  ";
+}
+
+/**
+ * 重要度と、各フォレストを書き出す。
+ * フォレストは、OpenCVの形式でメモリ上に書き出した文字列をzlibで圧縮し、長さとともに格納する。
+ */
+void RandomForestRegression::write(ofstream& out) const {
+	out.write((const char*)&numTrees, sizeof(int));
+	out.write((const char*)&maxDepth, sizeof(int));
+	out.write((const char*)&minSampleCount, sizeof(int));
+	writeMat(out, importance);
+
+	int numForests = forests.size();
+	out.write((const char*)&numForests, sizeof(int));
+	for (int c = 0; c < numForests; ++c) {
+		cv::FileStorage fs(".yml", cv::FileStorage::WRITE + cv::FileStorage::MEMORY);
+		forests[c]->write(*fs, "forest");
+		string str = fs.releaseAndGetString();
+
+		// テキストのままでは大きいので、圧縮して書き出す (長さを負にして、圧縮済みであることを表す)
+		QByteArray compressed = qCompress(QByteArray(str.c_str(), str.size()), 9);
+		int length = -compressed.size();
+		out.write((const char*)&length, sizeof(int));
+		out.write(compressed.constData(), compressed.size());
+	}
+}
+
+/**
+ * write()で書き出したモデルを読み込む。圧縮していない形式 (長さが正) も読み込める。
+ */
+void RandomForestRegression::read(ifstream& in) {
+	in.read((char*)&numTrees, sizeof(int));
+	in.read((char*)&maxDepth, sizeof(int));
+	in.read((char*)&minSampleCount, sizeof(int));
+	importance = readMat(in);
+
+	int numForests;
+	in.read((char*)&numForests, sizeof(int));
+	forests.resize(numForests);
+	for (int c = 0; c < numForests; ++c) {
+		int length;
+		in.read((char*)&length, sizeof(int));
+		string str(abs(length), '\0');
+		in.read(&str[0], str.size());
+		if (length < 0) {
+			QByteArray uncompressed = qUncompress(QByteArray(str.c_str(), str.size()));
+			if (uncompressed.isEmpty()) {
+				in.setstate(ios::failbit);
+				return;
+			}
+			str.assign(uncompressed.constData(), uncompressed.size());
+		}
+
+		cv::FileStorage fs(str, cv::FileStorage::READ + cv::FileStorage::MEMORY);
+		forests[c] = new CvRTrees();
+		forests[c]->read(*fs, (CvFileNode*)fs["forest"].node);
+	}
+}
+
+/**
+ * 正規化したhigh-level indicatorから定数項の列を除き、CvRTrees用にfloatに変換する。
+ */
+cv::Mat_<float> RandomForestRegression::toFeatures(const cv::Mat_<double>& Y2) const {
+	cv::Mat_<float> F;
+	Y2.colRange(0, Y2.cols - 1).convertTo(F, CV_32F);
+
+	return F;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "InverseModel.h"
+#include <opencv/ml.h>
+
+class RandomForestRegression : public InverseModel {
+	friend class ForestTrainer;
+	friend class ForestPredictor;
+
+private:
+	int numTrees;
+	int maxDepth;
+	int minSampleCount;
+	vector<cv::Ptr<CvRTrees> > forests;
+	cv::Mat_<double> importance;
+
+public:
+	RandomForestRegression(int numTrees = 100, int maxDepth = 12, int minSampleCount = 5);
+
+	void fit(const Dataset& dataset);
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y) const;
+	const cv::Mat_<double>& getImportance() const;
+
+protected:
+	string tag() const;
+	void write(ofstream& out) const;
+	void read(ifstream& in);
+
+private:
+	cv::Mat_<float> toFeatures(const cv::Mat_<double>& Y2) const;
+};
+
@@ -0,0 +1,181 @@
+﻿#include "RandomFourierFeatures.h"
+#include <random>
+
+using namespace std;
+
+/**
+ * ガウス過程のカーネルを、numFeatures個のランダムフーリエ特徴で近似した回帰モデルを学習する。
+ * 特徴空間でのリッジ回帰になるので、学習はO(N D^2)、推定はO(d D)で済む。
+ * hyperparameterの意味と初期値は、GaussianProcessと同じ。
+ *
+ * @param X				データ群 (各行が、各データx_iを表す)
+ * @param Y				観測データ群 (各行が、各観測データy_iを表す)
+ * @param numFeatures	ランダムフーリエ特徴の数
+ * @param seed			乱数のシード
+ */
+RandomFourierFeatures::RandomFourierFeatures(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, int numFeatures, unsigned seed) {
+	this->X = X.clone();
+	this->Y = Y.clone();
+	this->numFeatures = numFeatures;
+	this->seed = seed;
+
+	theta_0 = 1.0;
+	theta_1 = cv::Mat_<double>(1, X.cols, 16.0);
+	theta_2 = 0.0;
+	theta_3 = 0.0;
+	beta = 1.0e6;
+
+	fit();
+}
+
+/**
+ * 対数空間のhyperparameterを指定して、回帰モデルを学習する。
+ * 既定のhyperparameterでの学習を省くので、最適化済みのhyperparameterを使う場合は、
+ * setHyperparameters()で学習し直すより、こちらを使う。
+ *
+ * @param X				データ群 (各行が、各データx_iを表す)
+ * @param Y				観測データ群 (各行が、各観測データy_iを表す)
+ * @param numFeatures	ランダムフーリエ特徴の数
+ * @param params		hyperparameter (対数。GaussianProcess::getHyperparameters()と同じ並び)
+ * @param seed			乱数のシード
+ */
+RandomFourierFeatures::RandomFourierFeatures(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, int numFeatures, const cv::Mat_<double>& params, unsigned seed) {
+	this->X = X.clone();
+	this->Y = Y.clone();
+	this->numFeatures = numFeatures;
+	this->seed = seed;
+
+	setHyperparameters(params);
+}
+
+/**
+ * 対数空間のhyperparameterをセットし、学習し直す。
+ * 並びはGaussianProcess::getHyperparameters()と同じなので、
+ * ガウス過程で最適化したhyperparameterをそのまま使える。
+ *
+ * @param params	hyperparameter (対数)
+ */
+void RandomFourierFeatures::setHyperparameters(const cv::Mat_<double>& params) {
+	int D = params.cols - 4;
+
+	theta_0 = exp(params(0, 0));
+	theta_1 = cv::Mat_<double>(1, D);
+	for (int d = 0; d < D; ++d) {
+		theta_1(0, d) = exp(params(0, d + 1));
+	}
+	theta_2 = exp(params(0, D + 1));
+	theta_3 = exp(params(0, D + 2));
+	beta = exp(-params(0, D + 3));
+
+	fit();
+}
+
+/**
+ * 指定されたデータxに対応する値を推定する。
+ *
+ * @param x		データ (行ベクトル)
+ * @return		推定された値（行ベクトル）
+ */
+cv::Mat_<double> RandomFourierFeatures::predict(const cv::Mat_<double>& x) const {
+	return features(x) * W;
+}
+
+/**
+ * 複数のデータに対応する値を、まとめて推定する。
+ *
+ * @param X		データ群 (各行が、各データx_iを表す)
+ * @return		推定された値 (各行が、各データに対応する)
+ */
+cv::Mat_<double> RandomFourierFeatures::predictBatch(const cv::Mat_<double>& X) const {
+	return features(X) * W;
+}
+
+/**
+ * 複数のデータに対応する値を、予測分散とともにまとめて推定する。
+ * 重みの事後分布の共分散は noise * A^-1 なので、予測分散は noise * (1 + z^T A^-1 z) となる。
+ * 学習データから離れたデータほど、z^T A^-1 z が大きくなる。
+ *
+ * @param X					データ群 (各行が、各データx_iを表す)
+ * @param variance [OUT]	予測分散 (各行が、各データに対応する。各列が、各出力に対応する)
+ * @return					推定された値 (各行が、各データに対応する)
+ */
+cv::Mat_<double> RandomFourierFeatures::predictBatch(const cv::Mat_<double>& X, cv::Mat_<double>& variance) const {
+	cv::Mat_<double> Z = features(X);
+
+	// 各行について z^T A^-1 z を計算する
+	cv::Mat_<double> q;
+	cv::reduce((Z * Ainv).mul(Z), q, 1, CV_REDUCE_SUM);
+	variance = (q + 1.0) * noise;
+
+	return Z * W;
+}
+
+/**
+ * データを特徴空間に写像する。
+ * z(x) = [sqrt(2 theta_0 / D) cos(omega x + b), sqrt(theta_2), sqrt(theta_3) x] とすると、
+ * z(x)^T z(x') の期待値が、GaussianProcessの共分散関数と一致する。
+ *
+ * @param X		データ群 (各行が、各データx_iを表す)
+ * @return		特徴ベクトル群 (各行が、各データの特徴ベクトルを表す)
+ */
+cv::Mat_<double> RandomFourierFeatures::features(const cv::Mat_<double>& X) const {
+	int D = X.cols;
+
+	cv::Mat_<double> proj = X * omega.t();
+	cv::Mat_<double> Z(X.rows, numFeatures + 1 + D);
+	double s = sqrt(2.0 * theta_0 / numFeatures);
+	double s2 = sqrt(theta_2);
+	double s3 = sqrt(theta_3);
+	for (int r = 0; r < X.rows; ++r) {
+		const double* p = proj[r];
+		double* z = Z[r];
+		for (int k = 0; k < numFeatures; ++k) {
+			z[k] = s * cos(p[k] + phase(0, k));
+		}
+		z[numFeatures] = s2;
+		for (int d = 0; d < D; ++d) {
+			z[numFeatures + 1 + d] = s3 * X(r, d);
+		}
+	}
+
+	return Z;
+}
+
+/**
+ * ランダムフーリエ特徴をサンプリングし、特徴空間でリッジ回帰により重みWを求める。
+ * 正則化係数には、ガウス過程のノイズ 1/beta を使う。
+ */
+void RandomFourierFeatures::fit() {
+	int D = X.cols;
+
+	// RBFカーネルのスペクトル密度 N(0, diag(theta_1)) から、周波数をサンプリングする
+	std::mt19937 mt(seed);
+	std::uniform_real_distribution<> u(0.0, 2.0 * CV_PI);
+	omega = cv::Mat_<double>(numFeatures, D);
+	phase = cv::Mat_<double>(1, numFeatures);
+	for (int k = 0; k < numFeatures; ++k) {
+		for (int d = 0; d < D; ++d) {
+			std::normal_distribution<> n(0.0, sqrt(theta_1(0, d)));
+			omega(k, d) = n(mt);
+		}
+		phase(0, k) = u(mt);
+	}
+
+	// W = (Z^T Z + I / beta)^-1 Z^T Y
+	cv::Mat_<double> Z = features(X);
+	cv::Mat_<double> A;
+	cv::mulTransposed(Z, A, true);
+	A += cv::Mat_<double>::eye(A.rows, A.cols) / beta;
+	cv::Mat_<double> B = Z.t() * Y;
+	if (!cv::solve(A, B, W, cv::DECOMP_CHOLESKY)) {
+		cv::solve(A, B, W, cv::DECOMP_SVD);
+	}
+	if (cv::invert(A, Ainv, cv::DECOMP_CHOLESKY) == 0) {
+		cv::invert(A, Ainv, cv::DECOMP_SVD);
+	}
+
+	// 各出力のノイズの分散は、学習データの残差から推定する (ただし、1 / beta以上とする)
+	cv::Mat_<double> R = Z * W - Y;
+	cv::reduce(R.mul(R), noise, 0, CV_REDUCE_AVG);
+	cv::max(noise, 1.0 / beta, noise);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+
+class RandomFourierFeatures {
+private:
+	int numFeatures;
+	unsigned seed;
+	double theta_0;
+	cv::Mat_<double> theta_1;
+	double theta_2;
+	double theta_3;
+	double beta;
+	cv::Mat_<double> omega;
+	cv::Mat_<double> phase;
+	cv::Mat_<double> W;
+	cv::Mat_<double> Ainv;
+	cv::Mat_<double> noise;
+	cv::Mat_<double> X;
+	cv::Mat_<double> Y;
+
+public:
+	RandomFourierFeatures(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, int numFeatures, unsigned seed = 0);
+	RandomFourierFeatures(const cv::Mat_<double>& X, const cv::Mat_<double>& Y, int numFeatures, const cv::Mat_<double>& params, unsigned seed = 0);
+	void setHyperparameters(const cv::Mat_<double>& params);
+	cv::Mat_<double> predict(const cv::Mat_<double>& x) const;
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& X) const;
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& X, cv::Mat_<double>& variance) const;
+	cv::Mat_<double> features(const cv::Mat_<double>& X) const;
+
+private:
+	void fit();
+};
+
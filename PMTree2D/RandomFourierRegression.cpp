@@ -0,0 +1,88 @@
+﻿#include "RandomFourierRegression.h"
+#include "GaussianProcess.h"
+
+/**
+ * ランダムフーリエ特徴でガウス過程を近似した回帰によるinverseマッピング。
+ * hyperparameterは、先頭のmaxSamples個のサンプルでガウス過程として最適化し、
+ * そのhyperparameterで、全データからランダムフーリエ特徴の重みを求める。
+ *
+ * @param numFeatures		ランダムフーリエ特徴の数
+ * @param numStarts			最適化の初期値の数
+ * @param maxIterations		各初期値からの最大反復回数
+ * @param maxSamples		最適化に使用する最大データ数
+ * @param seed				乱数のシード
+ */
+RandomFourierRegression::RandomFourierRegression(int numFeatures, int numStarts, int maxIterations, int maxSamples, unsigned seed) {
+	this->numFeatures = numFeatures;
+	this->numStarts = numStarts;
+	this->maxIterations = maxIterations;
+	this->maxSamples = maxSamples;
+	this->seed = seed;
+}
+
+/**
+ * 正規化したhigh-level indicatorからPMパラメータへの回帰を学習する。
+ *
+ * @param dataset		学習データ
+ */
+void RandomFourierRegression::fit(const Dataset& dataset) {
+	normalize(dataset, X2, Y2);
+
+	int M = min(dataset.size(), maxSamples);
+	GaussianProcess gp(Y2.rowRange(0, M), X2.rowRange(0, M));
+	gp.optimize(numStarts, maxIterations, M);
+	params = gp.getHyperparameters();
+
+	rff = new RandomFourierFeatures(Y2, X2, numFeatures, params, seed);
+}
+
+/**
+ * 複数のhigh-level indicatorから、PMパラメータをまとめて推定する。
+ *
+ * @param Y		high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @return		PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> RandomFourierRegression::predictBatch(const cv::Mat_<double>& Y) const {
+	return denormalizeX(rff->predictBatch(normalizeY(Y)));
+}
+
+/**
+ * 複数のhigh-level indicatorから、PMパラメータと予測分散をまとめて推定する。
+ * 予測分散は正規化したPMパラメータの空間での値で、各列が各PMパラメータに対応する。
+ *
+ * @param Y					high-level indicator (各行が、各クエリを表す。定数項は含まない)
+ * @param variance [OUT]	予測分散
+ * @return					PMパラメータ (各行が、各クエリに対応する)
+ */
+cv::Mat_<double> RandomFourierRegression::predictBatch(const cv::Mat_<double>& Y, cv::Mat_<double>& variance) const {
+	return denormalizeX(rff->predictBatch(normalizeY(Y), variance));
+}
+
+string RandomFourierRegression::tag() const {
+	return "RFF ";
+}
+
+/**
+ * 特徴の数、乱数のシード、hyperparameter、正規化した学習データを書き出す。
+ * 特徴と重みは、読み込み時に同じシードで学習し直す (最適化はしない)。
+ */
+void RandomFourierRegression::write(ofstream& out) const {
+	out.write((const char*)&numFeatures, sizeof(int));
+	out.write((const char*)&seed, sizeof(unsigned));
+	writeMat(out, params);
+	writeMat(out, Y2);
+	writeMat(out, X2);
+}
+
+/**
+ * write()で書き出したモデルを読み込み、重みを求める。
+ */
+void RandomFourierRegression::read(ifstream& in) {
+	in.read((char*)&numFeatures, sizeof(int));
+	in.read((char*)&seed, sizeof(unsigned));
+	params = readMat(in);
+	Y2 = readMat(in);
+	X2 = readMat(in);
+
+	rff = new RandomFourierFeatures(Y2, X2, numFeatures, params, seed);
+}
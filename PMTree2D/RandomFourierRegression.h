@@ -0,0 +1,30 @@
+#pragma once
+
+#include "InverseModel.h"
+#include "RandomFourierFeatures.h"
+
+class RandomFourierRegression : public InverseModel {
+private:
+	int numFeatures;
+	int numStarts;
+	int maxIterations;
+	int maxSamples;
+	unsigned seed;
+	cv::Mat_<double> params;
+	cv::Mat_<double> X2;
+	cv::Mat_<double> Y2;
+	cv::Ptr<RandomFourierFeatures> rff;
+
+public:
+	RandomFourierRegression(int numFeatures = 1000, int numStarts = 8, int maxIterations = 50, int maxSamples = 500, unsigned seed = 0);
+
+	void fit(const Dataset& dataset);
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y) const;
+	cv::Mat_<double> predictBatch(const cv::Mat_<double>& Y, cv::Mat_<double>& variance) const;
+
+protected:
+	string tag() const;
+	void write(ofstream& out) const;
+	void read(ifstream& in);
+};
+
@@ -0,0 +1,108 @@
+﻿#include "SurrogateSimulator.h"
+#include "ForwardSimulator.h"
+
+/**
+ * PMパラメータから統計情報を推定するforwardの代理モデル。
+ * ランダムフーリエ特徴による回帰で、統計情報とその予測分散をまとめて推定し、
+ * 不確かさが閾値を超えたサンプルだけ、実際に木を生成する (ForwardSimulator)。
+ *
+ * @param statistics	統計情報の種類 (PMTree2D::getStatistics()を参照)
+ * @param numFeatures	ランダムフーリエ特徴の数
+ * @param threshold		不確かさの閾値 (正規化した統計情報の標準偏差)
+ */
+SurrogateSimulator::SurrogateSimulator(int statistics, int numFeatures, double threshold) {
+	this->statistics = statistics;
+	this->numFeatures = numFeatures;
+	this->threshold = threshold;
+	numPredicted = 0;
+	numSimulated = 0;
+}
+
+/**
+ * 学習データ (PMパラメータ -> 統計情報) から、代理モデルを学習する。
+ * inverseマッピングと入出力を入れ替えてRandomFourierRegressionで学習するので、正規化も同じものを使う
+ * (先頭のmaxSamples個でガウス過程のhyperparameterを最適化してから、全データでランダムフーリエ特徴の重みを求める)。
+ *
+ * @param dataset		学習データ (Xの各行がPMパラメータ、Yの各行が統計情報)
+ * @param maxSamples	hyperparameterの最適化に使用する最大データ数
+ */
+void SurrogateSimulator::fit(const Dataset& dataset, int maxSamples) {
+	model = new RandomFourierRegression(numFeatures, 8, 50, maxSamples);
+	model->fit(Dataset(dataset.Y, dataset.X));
+}
+
+/**
+ * 不確かさの閾値をセットする。0にすると、常に実際に木を生成する。
+ */
+void SurrogateSimulator::setThreshold(double threshold) {
+	this->threshold = threshold;
+}
+
+/**
+ * 複数のPMパラメータから、統計情報とその不確かさをまとめて推定する。
+ * 不確かさは、正規化した統計情報の予測標準偏差の、全出力にわたるRMSとする。
+ * (CMAESSolverなどのエラーと同じスケールになる)
+ *
+ * @param P						PMパラメータ (各行が、各サンプルを表す)
+ * @param S [OUT]				統計情報 (各行が、各サンプルに対応する)
+ * @param uncertainty [OUT]		不確かさ (列ベクトル)
+ */
+void SurrogateSimulator::predict(const cv::Mat_<double>& P, cv::Mat_<double>& S, cv::Mat_<double>& uncertainty) const {
+	cv::Mat_<double> variance;
+	S = model->predictBatch(P, variance);
+
+	cv::reduce(variance, uncertainty, 1, CV_REDUCE_AVG);
+	cv::sqrt(uncertainty, uncertainty);
+}
+
+/**
+ * 複数のPMパラメータから、統計情報を計算する。ForwardSimulator::simulate()の代わりに使う。
+ * 代理モデルで推定し、不確かさが閾値を超えたサンプルだけ、まとめて並列に木を生成する。
+ * 代理モデルは物理的にNGかどうかを判定できないので、推定したサンプルはOKとして扱う。
+ *
+ * @param P				PMパラメータ (各行が、各サンプルを表す)
+ * @param S [OUT]		統計情報 (各行が、各サンプルに対応する)
+ * @param valid [OUT]	各サンプルが物理的にOKかどうか (列ベクトル)
+ */
+void SurrogateSimulator::simulate(const cv::Mat_<double>& P, cv::Mat_<double>& S, cv::Mat_<uchar>& valid) {
+	cv::Mat_<double> uncertainty;
+	predict(P, S, uncertainty);
+	valid = cv::Mat_<uchar>::ones(P.rows, 1);
+
+	vector<int> indices;
+	for (int r = 0; r < P.rows; ++r) {
+		if (uncertainty(r, 0) > threshold) {
+			indices.push_back(r);
+		}
+	}
+	numPredicted += P.rows - indices.size();
+	numSimulated += indices.size();
+	if (indices.empty()) return;
+
+	// 不確かなサンプルだけ、実際に木を生成する
+	cv::Mat_<double> P2(indices.size(), P.cols);
+	for (int i = 0; i < indices.size(); ++i) {
+		P.row(indices[i]).copyTo(P2.row(i));
+	}
+	cv::Mat_<double> S2;
+	cv::Mat_<uchar> valid2;
+	ForwardSimulator::simulate(P2, S2, valid2, statistics);
+	for (int i = 0; i < indices.size(); ++i) {
+		S2.row(i).copyTo(S.row(indices[i]));
+		valid(indices[i], 0) = valid2(i, 0);
+	}
+}
+
+/**
+ * これまでに代理モデルで推定したサンプル数を返却する。
+ */
+int SurrogateSimulator::getNumPredicted() const {
+	return numPredicted;
+}
+
+/**
+ * これまでに実際に木を生成したサンプル数を返却する。
+ */
+int SurrogateSimulator::getNumSimulated() const {
+	return numSimulated;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include "Dataset.h"
+#include "RandomFourierRegression.h"
+
+class SurrogateSimulator {
+private:
+	int statistics;
+	int numFeatures;
+	double threshold;
+	cv::Ptr<RandomFourierRegression> model;
+	int numPredicted;
+	int numSimulated;
+
+public:
+	SurrogateSimulator(int statistics = 3, int numFeatures = 1000, double threshold = 0.05);
+
+	void fit(const Dataset& dataset, int maxSamples = 500);
+	void setThreshold(double threshold);
+	void predict(const cv::Mat_<double>& P, cv::Mat_<double>& S, cv::Mat_<double>& uncertainty) const;
+	void simulate(const cv::Mat_<double>& P, cv::Mat_<double>& S, cv::Mat_<uchar>& valid);
+	int getNumPredicted() const;
+	int getNumSimulated() const;
+};
+
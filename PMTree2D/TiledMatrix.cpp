@@ -0,0 +1,267 @@
+﻿#include "TiledMatrix.h"
+#include "GaussianProcess.h"
+
+using namespace std;
+
+/**
+ * ブロック列kの下側のタイルを、A_ik = A_ik L_kk^-T と並列に更新する。
+ * 更新したタイルは、ファイルに書き戻すとともに、右下のタイルの更新に使うためにpanelに保持する。
+ */
+class TilePanelSolver : public cv::ParallelLoopBody {
+private:
+	TiledMatrix* A;
+	int k;
+	const cv::Mat_<double>& Lkk;
+	vector<cv::Mat_<double> >& panel;
+
+public:
+	TilePanelSolver(TiledMatrix* A, int k, const cv::Mat_<double>& Lkk, vector<cv::Mat_<double> >& panel) : A(A), k(k), Lkk(Lkk), panel(panel) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int i = range.start; i < range.end; ++i) {
+			cv::Mat_<double> Aik = A->tile(i, k);
+			for (int r = 0; r < Aik.rows; ++r) {
+				double* a = Aik[r];
+				for (int c = 0; c < Aik.cols; ++c) {
+					const double* Lc = Lkk[c];
+					double t = a[c];
+					for (int m = 0; m < c; ++m) {
+						t -= Lc[m] * a[m];
+					}
+					a[c] = t / Lc[c];
+				}
+			}
+			A->setTile(i, k, Aik);
+			panel[i] = Aik;
+		}
+	}
+};
+
+/**
+ * ブロック列kより右下のタイルを、A_ij = A_ij - A_ik A_jk^T と並列に更新する。
+ * A_ikとA_jkは、メモリ上のpanelから読む。
+ */
+class TileUpdater : public cv::ParallelLoopBody {
+private:
+	TiledMatrix* A;
+	const vector<cv::Point>& tiles;
+	const vector<cv::Mat_<double> >& panel;
+
+public:
+	TileUpdater(TiledMatrix* A, const vector<cv::Point>& tiles, const vector<cv::Mat_<double> >& panel) : A(A), tiles(tiles), panel(panel) {}
+
+	void operator()(const cv::Range& range) const {
+		for (int t = range.start; t < range.end; ++t) {
+			int i = tiles[t].y;
+			int j = tiles[t].x;
+			cv::Mat_<double> Aij = A->tile(i, j);
+			cv::gemm(panel[i], panel[j], -1.0, Aij, 1.0, Aij, cv::GEMM_2_T);
+			A->setTile(i, j, Aij);
+		}
+	}
+};
+
+/**
+ * N x Nの対称行列を、tileSize x tileSizeのタイルに分けてファイル上に保持する。
+ * 下三角部分のタイルのみを保持し、タイルは使うときに1枚ずつ読み書きする。
+ * メモリ上に置くのは、各スレッドが処理中のタイルと、分解中のブロック列 (N x tileSize) だけなので、
+ * 物理メモリやアドレス空間に載り切らないサイズの行列も扱える。
+ * タイルの読み書きは、スレッドごとに別のファイルハンドルを使うので、並列に行える。
+ * ファイルを作成できない場合は、例外 (cv::Exception) を投げる。
+ *
+ * @param fileName		タイルを格納するファイル名 (破棄時に削除される)
+ * @param N				行列のサイズ
+ * @param tileSize		タイルのサイズ
+ */
+TiledMatrix::TiledMatrix(const std::string& fileName, int N, int tileSize) : fileName(fileName), file(QString::fromLocal8Bit(fileName.c_str())) {
+	this->N = N;
+	this->tileSize = tileSize;
+	numTiles = (N + tileSize - 1) / tileSize;
+
+	qint64 bytes = offset(numTiles, 0);
+	if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate | QIODevice::Unbuffered)) {
+		CV_Error(CV_StsError, "Cannot open the tile file " + fileName + ": " + file.errorString().toStdString());
+	}
+	if (!file.resize(bytes)) {
+		std::string message = file.errorString().toStdString();
+		file.close();
+		file.remove();
+		CV_Error(CV_StsNoMem, "Cannot allocate the tile file " + fileName + ": " + message);
+	}
+}
+
+TiledMatrix::~TiledMatrix() {
+	for (int i = 0; i < handles.size(); ++i) {
+		delete handles[i];
+	}
+	file.close();
+	file.remove();
+}
+
+int TiledMatrix::rows() const {
+	return N;
+}
+
+int TiledMatrix::getTileSize() const {
+	return tileSize;
+}
+
+int TiledMatrix::getNumTiles() const {
+	return numTiles;
+}
+
+/**
+ * (i, j)番目のタイルを、ファイルから読み込んで返却する。
+ * タイルはtileSize x tileSizeの連続した領域に置かれているので、1回の読み込みで読む。
+ * 返却される行列はコピーなので、変更した場合はsetTile()で書き戻す。
+ *
+ * @param i		タイルの行番号
+ * @param j		タイルの列番号 (j <= i)
+ * @return		タイル
+ */
+cv::Mat_<double> TiledMatrix::tile(int i, int j) const {
+	int rows = min(tileSize, N - i * tileSize);
+	int cols = min(tileSize, N - j * tileSize);
+	cv::Mat_<double> m(rows, tileSize);
+	qint64 bytes = (qint64)rows * tileSize * sizeof(double);
+
+	QFile* handle = acquireHandle();
+	bool ok = handle->seek(offset(i, j)) && handle->read((char*)m.data, bytes) == bytes;
+	std::string message = ok ? "" : handle->errorString().toStdString();
+	releaseHandle(handle);
+	if (!ok) {
+		CV_Error(CV_StsError, "Cannot read the tile file: " + message);
+	}
+
+	if (cols < tileSize) return m.colRange(0, cols).clone();
+	return m;
+}
+
+/**
+ * (i, j)番目のタイルを、ファイルに書き込む。
+ * 右端のタイルは、tileSize列に詰め直してから、1回の書き込みで書く。
+ *
+ * @param i		タイルの行番号
+ * @param j		タイルの列番号 (j <= i)
+ * @param m		タイル
+ */
+void TiledMatrix::setTile(int i, int j, const cv::Mat_<double>& m) {
+	CV_Assert(m.rows == min(tileSize, N - i * tileSize) && m.cols == min(tileSize, N - j * tileSize));
+
+	cv::Mat_<double> buf = m;
+	if (m.cols < tileSize || !m.isContinuous()) {
+		buf = cv::Mat_<double>::zeros(m.rows, tileSize);
+		m.copyTo(buf.colRange(0, m.cols));
+	}
+	qint64 bytes = (qint64)m.rows * tileSize * sizeof(double);
+
+	QFile* handle = acquireHandle();
+	bool ok = handle->seek(offset(i, j)) && handle->write((const char*)buf.data, bytes) == bytes;
+	std::string message = ok ? "" : handle->errorString().toStdString();
+	releaseHandle(handle);
+	if (!ok) {
+		CV_Error(CV_StsError, "Cannot write the tile file: " + message);
+	}
+}
+
+/**
+ * タイル単位のブロックコレスキー分解により、行列を下三角因子Lで上書きする。
+ * 各ステップでは、対角タイルを分解し、その下のタイル列と右下のタイルを並列に更新する。
+ * 右下のタイルの更新では、ブロック列をメモリ上に保持し、各タイルは1回ずつ読み書きする。
+ *
+ * @return		true - 成功 / false - 正定値でない
+ */
+bool TiledMatrix::cholesky() {
+	for (int k = 0; k < numTiles; ++k) {
+		cv::Mat_<double> Lkk;
+		if (!GaussianProcess::cholesky(tile(k, k), Lkk)) return false;
+		setTile(k, k, Lkk);
+
+		vector<cv::Mat_<double> > panel(numTiles);
+		cv::parallel_for_(cv::Range(k + 1, numTiles), TilePanelSolver(this, k, Lkk, panel));
+
+		vector<cv::Point> tiles;
+		for (int i = k + 1; i < numTiles; ++i) {
+			for (int j = k + 1; j <= i; ++j) {
+				tiles.push_back(cv::Point(j, i));
+			}
+		}
+		cv::parallel_for_(cv::Range(0, tiles.size()), TileUpdater(this, tiles, panel));
+	}
+
+	return true;
+}
+
+/**
+ * 分解済みの因子Lを使って、L Z = B を解き、BをZで上書きする。
+ *
+ * @param B [IN/OUT]	右辺 (N x M)
+ */
+void TiledMatrix::forwardSubstitution(cv::Mat_<double>& B) const {
+	for (int i = 0; i < numTiles; ++i) {
+		cv::Mat_<double> Bi = B.rowRange(i * tileSize, min((i + 1) * tileSize, N));
+		for (int j = 0; j < i; ++j) {
+			cv::gemm(tile(i, j), B.rowRange(j * tileSize, (j + 1) * tileSize), -1.0, Bi, 1.0, Bi);
+		}
+		GaussianProcess::forwardSubstitution(tile(i, i), Bi);
+	}
+}
+
+/**
+ * 分解済みの因子Lを使って、L^T Z = B を解き、BをZで上書きする。
+ *
+ * @param B [IN/OUT]	右辺 (N x M)
+ */
+void TiledMatrix::backSubstitution(cv::Mat_<double>& B) const {
+	for (int i = numTiles - 1; i >= 0; --i) {
+		cv::Mat_<double> Bi = B.rowRange(i * tileSize, min((i + 1) * tileSize, N));
+		for (int j = i + 1; j < numTiles; ++j) {
+			cv::gemm(tile(j, i), B.rowRange(j * tileSize, min((j + 1) * tileSize, N)), -1.0, Bi, 1.0, Bi, cv::GEMM_1_T);
+		}
+		GaussianProcess::backSubstitution(tile(i, i), Bi);
+	}
+}
+
+/**
+ * (i, j)番目のタイルの、ファイル上の位置を返却する。
+ * タイルは、下三角部分を行優先の順に並べ、各タイルはtileSize x tileSizeの領域を使う。
+ */
+qint64 TiledMatrix::offset(int i, int j) const {
+	return ((qint64)i * (i + 1) / 2 + j) * tileSize * tileSize * sizeof(double);
+}
+
+/**
+ * タイルの読み書きに使うファイルハンドルを取り出す。
+ * 空いているハンドルがなければ、新しく開く。ロックするのはハンドルの受け渡しだけで、読み書きは並列に行われる。
+ * ハンドルはバッファリングしないので、別のハンドルで書いた内容がそのまま読める。
+ *
+ * @return		ファイルハンドル (使い終わったらreleaseHandle()で返す)
+ */
+QFile* TiledMatrix::acquireHandle() const {
+	{
+		cv::AutoLock lock(handleLock);
+		if (!handles.empty()) {
+			QFile* handle = handles.back();
+			handles.pop_back();
+			return handle;
+		}
+	}
+
+	QFile* handle = new QFile(QString::fromLocal8Bit(fileName.c_str()));
+	if (!handle->open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+		std::string message = handle->errorString().toStdString();
+		delete handle;
+		CV_Error(CV_StsError, "Cannot open the tile file " + fileName + ": " + message);
+	}
+	return handle;
+}
+
+/**
+ * acquireHandle()で取り出したファイルハンドルを返す。
+ *
+ * @param handle	ファイルハンドル
+ */
+void TiledMatrix::releaseHandle(QFile* handle) const {
+	cv::AutoLock lock(handleLock);
+	handles.push_back(handle);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <QFile>
+#include <string>
+#include <vector>
+
+class TiledMatrix {
+private:
+	int N;
+	int tileSize;
+	int numTiles;
+	std::string fileName;
+	mutable QFile file;
+	mutable std::vector<QFile*> handles;
+	mutable cv::Mutex handleLock;
+
+public:
+	TiledMatrix(const std::string& fileName, int N, int tileSize);
+	~TiledMatrix();
+
+	int rows() const;
+	int getTileSize() const;
+	int getNumTiles() const;
+	cv::Mat_<double> tile(int i, int j) const;
+	void setTile(int i, int j, const cv::Mat_<double>& m);
+	bool cholesky();
+	void forwardSubstitution(cv::Mat_<double>& B) const;
+	void backSubstitution(cv::Mat_<double>& B) const;
+
+private:
+	qint64 offset(int i, int j) const;
+	QFile* acquireHandle() const;
+	void releaseHandle(QFile* handle) const;
+	TiledMatrix(const TiledMatrix&);
+	TiledMatrix& operator=(const TiledMatrix&);
+};
+
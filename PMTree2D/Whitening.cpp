@@ -0,0 +1,93 @@
+﻿#include "Whitening.h"
+
+using namespace std;
+
+/**
+ * 学習済みの平均と射影行列から、PCA/whiteningの変換を復元する。
+ *
+ * @param mean			平均 (行ベクトル)
+ * @param projection	射影行列 (元の次元 x 主成分の数)
+ */
+Whitening::Whitening(const cv::Mat_<double>& mean, const cv::Mat_<double>& projection) {
+	this->mean = mean.clone();
+	this->projection = projection.clone();
+}
+
+/**
+ * 主成分分析により、データを主成分空間に写像する変換を求める。
+ * 分散の累積がenergyの割合に達するまでの主成分だけを残す。
+ * whitenがtrueの場合は、各主成分を標準偏差で割って、分散を1にする。
+ *
+ * @param Y			データ群 (各行が、各データを表す)
+ * @param energy	残す分散の割合 (0 - 1)
+ * @param whiten	true - whiteningする / false - 射影のみ
+ */
+void Whitening::fit(const cv::Mat_<double>& Y, double energy, bool whiten) {
+	cv::Mat_<double> cov, mu;
+	cv::calcCovarMatrix(Y, cov, mu, CV_COVAR_NORMAL | CV_COVAR_ROWS | CV_COVAR_SCALE, CV_64F);
+	mean = mu;
+
+	// 固有値は降順に並ぶ (固有ベクトルは各行)
+	cv::Mat_<double> eigenvalues, eigenvectors;
+	cv::eigen(cov, eigenvalues, eigenvectors);
+
+	double total = cv::sum(cv::max(eigenvalues, 0.0))[0];
+	int k = 0;
+	double cumulative = 0.0;
+	while (k < eigenvalues.rows) {
+		cumulative += max(eigenvalues(k, 0), 0.0);
+		++k;
+		if (cumulative >= energy * total) break;
+	}
+
+	projection = eigenvectors.rowRange(0, k).t();
+	if (whiten) {
+		for (int i = 0; i < k; ++i) {
+			projection.col(i) /= sqrt(max(eigenvalues(i, 0), 1.0e-12));
+		}
+	}
+}
+
+/**
+ * データ群を主成分空間に写像する。平均の減算も含めて、1回の行列積 (cv::gemm) で済む。
+ *
+ * @param Y		データ群 (各行が、各データを表す)
+ * @return		写像したデータ群 (各行が、各データに対応する)
+ */
+cv::Mat_<double> Whitening::transform(const cv::Mat_<double>& Y) const {
+	cv::Mat_<double> offset = -mean * projection;
+	cv::Mat_<double> Z;
+	cv::gemm(Y, projection, 1.0, cv::repeat(offset, Y.rows, 1), 1.0, Z);
+
+	return Z;
+}
+
+/**
+ * 変換を破棄する。
+ */
+void Whitening::release() {
+	mean.release();
+	projection.release();
+}
+
+/**
+ * 変換が学習されていないかどうかを返却する。
+ */
+bool Whitening::empty() const {
+	return projection.empty();
+}
+
+/**
+ * 主成分の数を返却する。
+ */
+int Whitening::dims() const {
+	return projection.cols;
+}
+
+const cv::Mat_<double>& Whitening::getMean() const {
+	return mean;
+}
+
+const cv::Mat_<double>& Whitening::getProjection() const {
+	return projection;
+}
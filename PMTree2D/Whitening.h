@@ -0,0 +1,23 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+
+class Whitening {
+private:
+	cv::Mat_<double> mean;
+	cv::Mat_<double> projection;
+
+public:
+	Whitening() {}
+	Whitening(const cv::Mat_<double>& mean, const cv::Mat_<double>& projection);
+
+	void fit(const cv::Mat_<double>& Y, double energy, bool whiten = true);
+	cv::Mat_<double> transform(const cv::Mat_<double>& Y) const;
+	void release();
+	bool empty() const;
+	int dims() const;
+	const cv::Mat_<double>& getMean() const;
+	const cv::Mat_<double>& getProjection() const;
+};
+